@@ -0,0 +1,14 @@
+# Generates a large script for parse benchmarks:
+# python3 parse.py 32 > /tmp/parse.sl && snabl -P /tmp/parse.sl
+
+import sys
+
+mb = int(sys.argv[1]) if len(sys.argv) > 1 else 32
+size, i = 0, 0
+
+while size < mb * 1000000:
+    s = ("func: rule-{0}<Int Str> (let: x; 'rule-{0} {0} 1.5 [1 2 3] " +
+         "{{@x ''matched {0}'' ~n #a}} drop! _ @x {0} add-int 2 lt-int?, ...)\n").format(i)
+    sys.stdout.write(s)
+    size += len(s)
+    i += 1
@@ -0,0 +1,64 @@
+#include "snabl/env.hpp"
+#include "snabl/parser.hpp"
+
+using namespace snabl;
+
+static Int count_forms(const Forms &in) {
+	Int n(0);
+	
+	for (auto &f: in) {
+		n++;
+		
+		if (auto b = dynamic_cast<const forms::Body *>(f.imp); b) {
+			n += count_forms(b->body);
+		} else if (auto q = dynamic_cast<const forms::Query *>(f.imp); q) {
+			n++;
+		} else if (auto fi = dynamic_cast<const forms::Fimp *>(f.imp); fi) {
+			n += fi->type_ids.size();
+		}
+	}
+
+	return n;
+}
+
+static string gen_unit(Int i) {
+	return fmt("func: f%0<Int> (let: x (@x 1 +) (@x 2 *) "
+						 "{@x (1 (2 3 +) +) [1 2 (3 4 +)]} drop! + "
+						 "((@x < 3) if: (1 (2 3 +) +) (2 [4 5] drop!)) drop!)\n"
+						 "(%0 f%0) (((%0 1 +) 2 *) %0 <) 'f%0 ''f%0'' [.. %0] drop! drop! drop! drop! "
+						 "drop!\n",
+						 {i});
+}
+
+static Int count_unit() {
+	Env env;
+	Arena arena;
+	Forms forms;
+	const auto in(gen_unit(0));
+	Parser(env, arena).parse(in, forms);
+	return count_forms(forms);
+}
+
+int main(int argc, const char *argv[]) {
+	const Int unit(count_unit());
+	
+	for (Int n: {10000, 100000, 1000000}) {
+		string in;
+		for (Int i(0); i < n/unit; i++) { in += gen_unit(i); }
+		const Int nforms(n/unit*unit);
+		
+		Env env;
+		const Int start_pc(env.ops().size());
+		const auto t(steady_clock::now());
+		env.compile(in);
+		const auto us(duration_cast<microseconds>(steady_clock::now()-t).count());
+		const Int nops(env.ops().size()-start_pc);
+
+		cout << fmt("%0 forms, %1 ops: %2 ms, %3 forms/s, %4 ops/s",
+								{nforms, nops, us/1000,
+								 us ? nforms*1000000/us : 0,
+								 us ? nops*1000000/us : 0}) << endl;
+	}
+
+	return 0;
+}
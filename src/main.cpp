@@ -1,14 +1,77 @@
 #include "snabl/env.hpp"
+#include "snabl/mapped_file.hpp"
+#include "snabl/parser.hpp"
 #include "snabl/repl.hpp"
 #include "tests.hpp"
 
 using namespace snabl;
 
-enum class Mode { Compile, Default, Repl, Run };
+enum class Mode { Compile, Default, Parse, Profile, Repl, Run };
+
+static bool is_fallthrough(const Op &op) {
+	switch (op.code) {
+	case OpCode::Fimp:
+	case OpCode::Jump:
+	case OpCode::Lambda:
+	case OpCode::Recall:
+	case OpCode::Return:
+	case OpCode::Throw:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static void dump_op(const Op &op, Int pc, ostream &out) {
+	out << pc << '\t';
+	if (op.depth == -1) { out << '?'; } else { out << op.depth; }
+	out << '\t';
+	op.dump(out);
+}
+
+static void dump_seqs(Env &env, ostream &out) {
+	const Int nops(env.ops().size());
+	unordered_set<const Op *> live;
+	for (auto pc: env.live_ops(0, nops)) { live.insert(&env.ops()[pc]); }
+	map<string, Int> counts;
+
+	for (auto op: live) {
+		if (!is_fallthrough(*op) || !live.count(op->next)) { continue; }
+		const auto &next(*op->next);
+		const auto id(op->type.id + ' ' + next.type.id);
+		counts[id]++;
+		
+		if (is_fallthrough(next) && live.count(next.next)) {
+			counts[id + ' ' + next.next->type.id]++;
+		}
+	}
+
+	vector<pair<Int, string>> sorted;
+	for (auto &c: counts) { sorted.emplace_back(c.second, c.first); }
+	sort(sorted.begin(), sorted.end(), greater<pair<Int, string>>());
+	for (auto &c: sorted) { out << c.first << '\t' << c.second << endl; }
+}
+
+static void parse_file(Env &env, const string &path) {
+	const MappedFile f(path);
+	const auto in(f.view());
+	Arena arena(in.size()*Parser::arena_ratio);
+	Forms forms;
+	const auto t(steady_clock::now());
+	Parser(env, arena).parse(in, forms);
+	const auto us(duration_cast<microseconds>(steady_clock::now()-t).count());
+	const Float mb(in.size()/1e6);
+	
+	cout << fmt("%0: %1 MB in %2 ms, %3 MB/s",
+							{path, mb, us/1000, us ? Int(mb*1e6/us) : Int(0)}) << endl;
+}
 
 int main(int argc, const char *argv[]) {
 	Env env;
 	Mode mode(Mode::Default);
+	bool stats(false);
+	string out_path, cache_dir, image_path;
+	Int start_pc(0);
 	argc--;
 	
 	for (const char **ap(argv+1); argc; argc--, ap++) {
@@ -16,42 +79,129 @@ int main(int argc, const char *argv[]) {
 		
 		if (a[0] == '-') {
 			switch (a[1]) {
+			case 'C':
+			case 'I':
+			case 'i':
+			case 'o':
+				if (argc == 1) { throw Error(fmt("Missing path: %0", {a})); }
+				argc--;
+				ap++;
+				
+				switch (a[1]) {
+				case 'C':
+					cache_dir = *ap;
+					break;
+				case 'I':
+					image_path = *ap;
+					break;
+				case 'i':
+					env.load_file(*ap);
+					start_pc = env.ops().size();
+					if (mode == Mode::Default) { mode = Mode::Run; }
+					break;
+				default:
+					out_path = *ap;
+				}
+				
+				break;
+			case 'P':
+				mode = Mode::Parse;
+				break;
 			case 'c':
 				mode = Mode::Compile;
+				env.peephole = false;
+				break;
+			case 'f':
+				mode = Mode::Profile;
+				break;
+			case 'j':
+				env.jit = true;
+				break;
+			case 'p':
+				env.peephole = false;
+				break;
+			case 's':
+				stats = true;
 				break;
 			default:
 				throw Error(fmt("Invalid flag: %0", {a}));
 			}
 		} else {
-			ifstream f(a);
-			if (f.fail()) { throw Error(fmt("File not found: %0", {a})); }
-			env.compile(f);
+			if (mode == Mode::Parse) {
+				parse_file(env, a);
+			} else if (a.size() > 4 && a.compare(a.size()-4, 4, ".sbc") == 0) {
+				env.load_file(a);
+			} else if (!cache_dir.empty()) {
+				env.compile_cached(a, cache_dir);
+			} else {
+				env.compile_file(a);
+			}
+			
 			if (mode == Mode::Default) { mode = Mode::Run; }
 		}
 	}
+
+	if (!out_path.empty()) {
+		ofstream f(out_path, ios::binary);
+		if (f.fail()) { throw Error(fmt("Failed opening file: %0", {out_path})); }
+		env.save(f, 0, env.ops().size());
+		return 0;
+	}
 	
 	switch (mode) {
 	case Mode::Compile: {
-		Int row(0);
-		for (const auto &op: env.ops()) {
-			cout << row++ << '\t';
-			op.dump(cout);
-		}
+		const Int nops(env.ops().size());
+		
+		for (Int pc(0); pc < nops; pc++) { dump_op(env.ops()[pc], pc, cout); }
+
+		env.optimize(0, nops);
+		const auto live(env.live_ops(0, nops));
+		cout << endl;
+		
+		for (auto pc: live) { dump_op(env.ops()[pc], pc, cout); }
+
+		cout << endl << fmt("%0 -> %1 ops", {nops, Int(live.size())}) << endl;
 		break;
 	}
+	case Mode::Parse:
+		break;
+	case Mode::Profile:
+		dump_seqs(env, cout);
+		break;
 	case Mode::Default:
 	case Mode::Repl:
 		all_tests();
 		repl(env, cin, cout);
 		break;
 	case Mode::Run:
-		if (!env.ops().empty()) {
-			env.jump(Int(0));
+		if (Int(env.ops().size()) > start_pc) {
+			env.jump(start_pc);
 			env.run();
 		}
 		
 		break;
 	}
+
+	if (!image_path.empty()) {
+		ofstream f(image_path, ios::binary);
+		if (f.fail()) { throw Error(fmt("Failed opening file: %0", {image_path})); }
+		env.save_image(f);
+	}
+
+	if (stats) {
+		const auto &s(env.fimp_cache_stats());
+		
+		cerr << fmt("Fimp cache hits: %0, misses: %1, megamorphic: %2",
+								{s.hits, s.misses, s.megamorphic}) << endl;
+
+		const auto &is(env.infer_stats());
+		
+		cerr << fmt("Typed call sites: %0/%1",
+								{is.resolved, is.calls}) << endl;
+
+		const auto &js(env.jit_stats());
+		cerr << fmt("Jitted targets: %0, ops: %1", {js.fns, js.ops}) << endl;
+	}
 	
 	return 0;
 }
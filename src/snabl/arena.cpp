@@ -0,0 +1,26 @@
+#include <cstdlib>
+
+#include "snabl/arena.hpp"
+
+namespace snabl {
+	const size_t Arena::min_block_size(4096), Arena::max_block_size(1 << 24);
+	
+	Arena::Arena(size_t block_size):
+		_ptr(nullptr), _end(nullptr),
+		_block_size(clamp(block_size, min_block_size, max_block_size)), _size(0) { }
+
+	Arena::~Arena() {
+		for (auto i(_dtors.rbegin()); i != _dtors.rend(); i++) { i->first(i->second); }
+		for (auto b: _blocks) { free(b); }
+	}
+
+	void Arena::grow(size_t size) {
+		if (!_blocks.empty()) { _block_size = min(_block_size*2, max_block_size); }
+		const auto n(max(size, _block_size));
+		auto p(static_cast<char *>(malloc(n)));
+		if (!p) { throw bad_alloc(); }
+		_blocks.push_back(p);
+		_ptr = p;
+		_end = p+n;
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef SNABL_ARENA_HPP
+#define SNABL_ARENA_HPP
+
+#include "snabl/std.hpp"
+
+namespace snabl {
+	/* Bump allocator; everything is released at once when the arena goes away,
+		 destructors only run for types that need them. */
+	
+	class Arena {
+	public:
+		static const size_t min_block_size, max_block_size;
+		
+		Arena(size_t block_size=0);
+		~Arena();
+		Arena(const Arena &) = delete;
+		const Arena &operator=(const Arena &) = delete;
+
+		template <typename T, typename... ArgsT>
+		T &make(ArgsT &&... args);
+
+		template <typename T, typename IterT>
+		T *copy(IterT begin, IterT end);
+		
+		size_t size() const { return _size; }
+	private:
+		vector<char *> _blocks;
+		vector<pair<void (*)(void *), void *>> _dtors;
+		char *_ptr, *_end;
+		size_t _block_size, _size;
+
+		static uintptr_t align_up(const char *p, size_t align) {
+			return (reinterpret_cast<uintptr_t>(p)+align-1) & ~uintptr_t(align-1);
+		}
+		
+		void *alloc(size_t size, size_t align) {
+			auto p(align_up(_ptr, align));
+			
+			if (!_ptr || p+size > reinterpret_cast<uintptr_t>(_end)) {
+				grow(size+align);
+				p = align_up(_ptr, align);
+			}
+
+			_ptr = reinterpret_cast<char *>(p+size);
+			_size += size;
+			return reinterpret_cast<void *>(p);
+		}
+
+		void grow(size_t size);
+	};
+
+	template <typename T, typename... ArgsT>
+	T &Arena::make(ArgsT &&... args) {
+		auto p(new (alloc(sizeof(T), alignof(T))) T(forward<ArgsT>(args)...));
+
+		if constexpr (!is_trivially_destructible_v<T>) {
+			_dtors.emplace_back([](void *p) { static_cast<T *>(p)->~T(); }, p);
+		}
+
+		return *p;
+	}
+
+	template <typename T, typename IterT>
+	T *Arena::copy(IterT begin, IterT end) {
+		static_assert(is_trivially_destructible_v<T>);
+		const size_t n(distance(begin, end));
+		if (!n) { return nullptr; }
+		auto p(static_cast<T *>(alloc(sizeof(T)*n, alignof(T))));
+		uninitialized_copy(begin, end, p);
+		return p;
+	}
+}
+
+#endif
@@ -34,10 +34,12 @@ namespace snabl {
 		}
 
 		virtual ~AType() { }
+
+		const unordered_set<ATypePtr> &child_types() const { return _child_types; }
 		
-		bool isa(const ATypePtr &parent) const {
+		bool isa(const AType *parent) const {
 			return
-				parent.get() == this ||
+				parent == this ||
 				(Int(_parent_types.size()) > parent->tag && _parent_types[parent->tag]);
 		}
 
@@ -8,56 +8,137 @@
 #include "snabl/std.hpp"
 
 namespace snabl {
+	struct BoxCell {
+		Int nrefs;
+		BoxCell(): nrefs(1) { }
+		virtual ~BoxCell() { }
+	};
+
+	template <typename ValT>
+	struct BoxCellT: public BoxCell {
+		ValT val;
+		BoxCellT(const ValT &val): val(val) { }
+	};
+
 	struct Box {
-		Box(const ATypePtr &type): _type(type) { }
-		
 		template <typename ValT>
-		Box(const TypePtr<ValT> &type, const ValT &val): _type(type), _val(val) { }
+		static constexpr bool is_inline() {
+			return
+				sizeof(ValT) <= sizeof(void *) &&
+				alignof(ValT) <= alignof(void *) &&
+				is_trivially_copyable_v<ValT>;
+		}
+
+		Box(const ATypePtr &type): _type(type_bits(type.get()) | Empty), _val() { }
+
+		template <typename ValT>
+		Box(const TypePtr<ValT> &type, const ValT &val):
+			_type(type_bits(type.get()) | (is_inline<ValT>() ? 0 : Heap)) {
+			if constexpr (is_inline<ValT>()) {
+				new (_val.data) ValT(val);
+			} else {
+				_val.cell = new BoxCellT<ValT>(val);
+			}
+		}
+
+		Box(const Box &source): _type(source._type), _val(source._val) {
+			if (_type & Heap) { _val.cell->nrefs++; }
+		}
+
+		Box(Box &&source): _type(source._type), _val(source._val) {
+			if (_type & Heap) { source._type = (source._type & ~Heap) | Empty; }
+		}
+
+		~Box() { release(); }
+
+		const Box &operator =(const Box &source) {
+			if (source._type & Heap) { source._val.cell->nrefs++; }
+			release();
+			_type = source._type;
+			_val = source._val;
+			return *this;
+		}
+
+		const Box &operator =(Box &&source) {
+			if (&source != this) {
+				release();
+				_type = source._type;
+				_val = source._val;
+				if (_type & Heap) { source._type = (source._type & ~Heap) | Empty; }
+			}
+
+			return *this;
+		}
 
 		template <typename ValT>
 		const ValT &as() const {
-			assert(sizeof(ValT) == _type->size);
-			return any_cast<const ValT &>(_val);
+			if constexpr (is_inline<ValT>()) {
+				return *reinterpret_cast<const ValT *>(_val.data);
+			} else {
+				return static_cast<const BoxCellT<ValT> *>(_val.cell)->val;
+			}
 		}
 
 		template <typename ValT>
 		ValT &as() {
-			assert(sizeof(ValT) == _type->size);
-			return any_cast<ValT &>(_val);
+			if constexpr (is_inline<ValT>()) {
+				return *reinterpret_cast<ValT *>(_val.data);
+			} else {
+				return static_cast<BoxCellT<ValT> *>(_val.cell)->val;
+			}
 		}
 
-		const ATypePtr &type() const { return _type; }
+		AType *type() const { return reinterpret_cast<AType *>(_type & ~Flags); }
 		bool isa(const ATypePtr &rhs) const;
-		
+
 		bool equid(const Box &rhs) const {
-			if (rhs.type() != _type) { return false; }
-			return _type->equid(*this, rhs);
+			if (rhs.type() != type()) { return false; }
+			return type()->equid(*this, rhs);
 		}
-		
+
 		bool eqval(const Box &rhs) const {
-			if (rhs.type() != _type) { return false; }
-			return _type->eqval(*this, rhs);
+			if (rhs.type() != type()) { return false; }
+			return type()->eqval(*this, rhs);
 		}
-		
+
 		Cmp cmp(const Box &rhs) const {
-			auto rt(rhs.type());
-			if (rt != _type) { return snabl::cmp(_type->tag, rt->tag); }
-			return _type->cmp(*this, rhs);
+			auto lt(type()), rt(rhs.type());
+			if (rt != lt) { return snabl::cmp(lt->tag, rt->tag); }
+			return lt->cmp(*this, rhs);
 		}
 
-		bool has_val() const { return _val.has_value(); }
-		bool as_bool() const { return _type->as_bool(*this); }
+		bool has_val() const { return !(_type & Empty); }
+		bool as_bool() const { return type()->as_bool(*this); }
 
-		void call(Pos pos, bool now) const { _type->call(*this, pos, now); }
-		IterPtr iter() const { return _type->iter(*this); }
-		void dump(ostream &out) const { _type->dump(*this, out); }
-		void print(ostream &out) const { _type->print(*this, out); }
-		void write(ostream &out) const { _type->write(*this, out); }
+		void call(Pos pos, bool now) const { type()->call(*this, pos, now); }
+		IterPtr iter() const { return type()->iter(*this); }
+		void dump(ostream &out) const { type()->dump(*this, out); }
+		void print(ostream &out) const { type()->print(*this, out); }
+		void write(ostream &out) const { type()->write(*this, out); }
 	private:
-		ATypePtr _type;
-		any _val;
+		enum: uintptr_t {Empty=1, Heap=2, Flags=Empty|Heap};
+
+		uintptr_t _type;
+
+		union Val {
+			alignas(void *) unsigned char data[sizeof(void *)];
+			BoxCell *cell;
+		} _val;
+
+		static uintptr_t type_bits(const AType *type) {
+			static_assert(alignof(AType) > Flags);
+			return reinterpret_cast<uintptr_t>(type);
+		}
+
+		void release() {
+			if (_type & Heap && !--_val.cell->nrefs) { delete _val.cell; }
+		}
+
+		friend class Jit;
 	};
 
+	static_assert(sizeof(Box) == 16);
+
 	inline ostream &operator <<(ostream &out, const Box &x) {
 		x.print(out);
 		return out;
@@ -0,0 +1,832 @@
+#include <cstring>
+
+#include <unistd.h>
+
+#include "snabl/env.hpp"
+#include "snabl/fimp.hpp"
+#include "snabl/func.hpp"
+#include "snabl/lambda.hpp"
+#include "snabl/mapped_file.hpp"
+
+namespace snabl {
+	static const char bytecode_magic[8] = {'S', 'N', 'A', 'B', 'L', 'B', 'C', 0};
+	static const Int bytecode_version(2);
+
+	/* Layout: magic, version, then the symbol table, literal pool, fimp table,
+		 ops and root vars; images add var values and the stack. All numbers are
+		 native Ints; pcs are relative to the first op. Stack and lambda literals
+		 refer to earlier entries in the pool. */
+
+	static Int op_nargs(OpCode code) {
+		switch (code) {
+		case OpCode::Call:
+		case OpCode::DDrop:
+		case OpCode::Drop:
+		case OpCode::Dup:
+		case OpCode::Nop:
+		case OpCode::Recall:
+		case OpCode::Return:
+		case OpCode::Rot:
+		case OpCode::RSwap:
+		case OpCode::SDrop:
+		case OpCode::Split:
+		case OpCode::SplitEnd:
+		case OpCode::Swap:
+		case OpCode::TryEnd:
+			return 0;
+		case OpCode::Else:
+		case OpCode::Eqval:
+		case OpCode::Fimp:
+		case OpCode::Isa:
+		case OpCode::Jump:
+		case OpCode::Push:
+		case OpCode::Stack:
+		case OpCode::Times:
+		case OpCode::Try:
+			return 1;
+		case OpCode::Case:
+		case OpCode::CaseDrop:
+		case OpCode::JumpIf:
+		case OpCode::LetSlot:
+			return 2;
+		case OpCode::GetSlot:
+			return 3;
+		case OpCode::AddInt:
+		case OpCode::AddIntLit:
+		case OpCode::DecInt:
+		case OpCode::Funcall:
+		case OpCode::IncInt:
+		case OpCode::Lambda:
+		case OpCode::LtInt:
+		case OpCode::LtIntLit:
+		case OpCode::MulInt:
+		case OpCode::MulIntLit:
+		case OpCode::SubInt:
+		case OpCode::SubIntLit:
+		case OpCode::TailCall:
+		case OpCode::Throw:
+			return 4;
+		default:
+			return -1;
+		}
+	}
+
+	static const ops::Funcall::Type &funcall_type(OpCode code) {
+		switch (code) {
+		case OpCode::AddInt:
+			return ops::AddInt::type;
+		case OpCode::AddIntLit:
+			return ops::AddIntLit::type;
+		case OpCode::DecInt:
+			return ops::DecInt::type;
+		case OpCode::IncInt:
+			return ops::IncInt::type;
+		case OpCode::LtInt:
+			return ops::LtInt::type;
+		case OpCode::LtIntLit:
+			return ops::LtIntLit::type;
+		case OpCode::MulInt:
+			return ops::MulInt::type;
+		case OpCode::MulIntLit:
+			return ops::MulIntLit::type;
+		case OpCode::SubInt:
+			return ops::SubInt::type;
+		case OpCode::SubIntLit:
+			return ops::SubIntLit::type;
+		case OpCode::TailCall:
+			return ops::TailCall::type;
+		case OpCode::Throw:
+			return ops::Throw::type;
+		default:
+			return ops::Funcall::type;
+		}
+	}
+
+	static void put(ostream &out, Int val) {
+		out.write(reinterpret_cast<const char *>(&val), sizeof(val));
+	}
+
+	static void put(ostream &out, const string &val) {
+		put(out, Int(val.size()));
+		out.write(val.data(), val.size());
+	}
+
+	class BytecodeWriter {
+	public:
+		BytecodeWriter(const Env &env, Int start_pc, Int end_pc):
+			_env(env), _start_pc(start_pc), _end_pc(end_pc), _nlits(0), _nvars(0), _nstack(0) { }
+
+		Int sym(Sym id) {
+			const auto found(_sym_idx.find(id));
+			if (found != _sym_idx.end()) { return found->second; }
+			_syms.push_back(id);
+			return _sym_idx.emplace(id, _syms.size()-1).first->second;
+		}
+
+		void var(Sym id, Int slot, const Box *val) {
+			Int v(-1);
+			
+			try {
+				if (val) { v = lit(*val); }
+			} catch (const Error &e) {
+				throw Error(fmt("Failed saving var %0: %1", {id, e.what()}));
+			}
+			
+			put(_vars, sym(id));
+			put(_vars, slot);
+			put(_vars, v);
+			_nvars++;
+		}
+
+		void push(const Box &val) {
+			Int v(-1);
+			
+			try {
+				v = lit(val);
+			} catch (const Error &e) {
+				throw Error(fmt("Failed saving stack: %0", {e.what()}));
+			}
+
+			put(_stack, v);
+			_nstack++;
+		}
+
+		void write(ostream &out, bool image) {
+			for (Int pc(_start_pc); pc < _end_pc; pc++) { op(_env.ops()[pc]); }
+			out.write(bytecode_magic, sizeof(bytecode_magic));
+			put(out, bytecode_version);
+			put(out, Int(_syms.size()));
+			for (auto &s: _syms) { put(out, s.name()); }
+			put(out, _nlits);
+			out << _lits.str();
+			put(out, Int(_fimps.size()));
+			out << _fimp_buf.str();
+			put(out, _end_pc-_start_pc);
+			out << _ops.str();
+			put(out, _nvars);
+			out << _vars.str();
+			put(out, image);
+			
+			if (image) {
+				put(out, _nstack);
+				out << _stack.str();
+			}
+		}
+	private:
+		const Env &_env;
+		const Int _start_pc, _end_pc;
+		unordered_map<Sym, Int> _sym_idx;
+		vector<Sym> _syms;
+		unordered_map<const Fimp *, Int> _fimps;
+		unordered_map<const void *, Int> _refs;
+		stringstream _lits, _fimp_buf, _ops, _vars, _stack;
+		Int _nlits, _nvars, _nstack;
+
+		Int pc(Int pc) const { return pc-_start_pc; }
+
+		Int pc(const Op *op) const {
+			if (!op) { return -1; }
+			const auto i(_env.ops().index_of(op));
+			return (i < _start_pc || i >= _end_pc) ? _end_pc-_start_pc : i-_start_pc;
+		}
+
+		Int lit(const Box &val) {
+			const auto t(val.type());
+			const void *ref(nullptr);
+			vector<Int> items;
+
+			// Stacks and lambdas are shared by reference, items are written first
+			
+			if (val.has_val()) {
+				if (t == _env.stack_type.get()) {
+					ref = val.as<StackPtr>().get();
+				} else if (t == _env.lambda_type.get()) {
+					ref = val.as<LambdaPtr>().get();
+				}
+			}
+
+			if (ref) {
+				const auto found(_refs.find(ref));
+
+				if (found != _refs.end()) {
+					if (found->second == -1) { throw Error("Cyclic stack"); }
+					return found->second;
+				}
+
+				_refs.emplace(ref, -1);
+				
+				if (t == _env.stack_type.get()) {
+					for (auto &v: *val.as<StackPtr>()) { items.push_back(lit(v)); }
+				}
+			}
+			
+			auto &out(_lits);
+			put(out, sym(t->id));
+			put(out, val.has_val());
+
+			if (val.has_val()) {
+				if (t == _env.bool_type.get()) {
+					put(out, val.as<bool>());
+				} else if (t == _env.char_type.get()) {
+					put(out, val.as<Char>());
+				} else if (t == _env.float_type.get()) {
+					Int v;
+					memcpy(&v, &val.as<Float>(), sizeof(v));
+					put(out, v);
+				} else if (t == _env.int_type.get()) {
+					put(out, val.as<Int>());
+				} else if (t == _env.lambda_type.get()) {
+					const auto &l(*val.as<LambdaPtr>());
+					const auto &ps(l.parent_scope());
+
+					if (ps && ps != _env.root_scope) {
+						throw Error("Lambda in local scope is not serializable");
+					}
+					
+					put(out, pc(l.start_pc()));
+					put(out, pc(l.end_pc()));
+					put(out, Int(l.opts()));
+					put(out, l.nvars());
+					put(out, ps != nullptr);
+				} else if (t == _env.meta_type.get()) {
+					put(out, sym(val.as<ATypePtr>()->id));
+				} else if (t == _env.stack_type.get()) {
+					put(out, Int(items.size()));
+					for (auto i: items) { put(out, i); }
+				} else if (t == _env.str_type.get()) {
+					put(out, *val.as<StrPtr>());
+				} else if (t == _env.sym_type.get()) {
+					put(out, sym(val.as<Sym>()));
+				} else if (t == _env.time_type.get()) {
+					put(out, val.as<Time>().ns);
+				} else if (t != _env.nil_type.get()) {
+					throw Error(fmt("Literal not serializable: %0", {t->id}));
+				}
+			}
+
+			if (ref) { _refs[ref] = _nlits; }
+			return _nlits++;
+		}
+
+		Int fimp(const Fimp &fi) {
+			const auto found(_fimps.find(&fi));
+			if (found != _fimps.end()) { return found->second; }
+			auto &out(_fimp_buf);
+			put(out, sym(fi.func->id));
+			put(out, Int(fi.args.size()));
+			for (auto &a: fi.args) { put(out, lit(a)); }
+			put(out, pc(fi.start_pc()));
+			put(out, pc(fi.end_pc()));
+			put(out, Int(fi.opts()));
+			put(out, fi.nvars());
+			put(out, fi.parent_scope() != nullptr);
+			put(out, fi.pure);
+			return _fimps.emplace(&fi, _fimps.size()).first->second;
+		}
+
+		void op(const Op &op) {
+			auto &out(_ops);
+			put(out, Int(op.type.code));
+			put(out, Int(op.code));
+			put(out, op.pos.row);
+			put(out, op.pos.col);
+			put(out, pc(op.next));
+			put(out, op.depth);
+
+			switch (op.type.code) {
+			case OpCode::Case:
+			case OpCode::CaseDrop: {
+				const auto &o(op.as<ops::Case>());
+				put(out, lit(o.rhs));
+				put(out, pc(o.skip_pc));
+				break;
+			}
+			case OpCode::Else:
+				put(out, pc(op.as<ops::Else>().skip_pc));
+				break;
+			case OpCode::Eqval: {
+				const auto &o(op.as<ops::Eqval>());
+				put(out, o.rhs ? lit(*o.rhs) : -1);
+				break;
+			}
+			case OpCode::Fimp:
+				put(out, fimp(*op.as<ops::Fimp>().ptr));
+				break;
+			case OpCode::GetSlot: {
+				const auto &o(op.as<ops::GetSlot>());
+				put(out, sym(o.id));
+				put(out, o.depth);
+				put(out, o.slot);
+				break;
+			}
+			case OpCode::Isa:
+				put(out, sym(op.as<ops::Isa>().rhs->id));
+				break;
+			case OpCode::Jump:
+				put(out, pc(op.as<ops::Jump>().end_pc));
+				break;
+			case OpCode::JumpIf: {
+				const auto &o(op.as<ops::JumpIf>());
+				put(out, o.i_reg);
+				put(out, pc(o.end_pc));
+				break;
+			}
+			case OpCode::Lambda: {
+				const auto &o(op.as<ops::Lambda>());
+				put(out, pc(o.start_pc));
+				put(out, pc(o.end_pc));
+				put(out, Int(o.opts));
+				put(out, o.nvars);
+				break;
+			}
+			case OpCode::LetSlot: {
+				const auto &o(op.as<ops::LetSlot>());
+				put(out, sym(o.id));
+				put(out, o.slot);
+				break;
+			}
+			case OpCode::Push:
+				put(out, lit(op.as<ops::Push>().val));
+				break;
+			case OpCode::Stack:
+				put(out, op.as<ops::Stack>().end_split);
+				break;
+			case OpCode::Times:
+				put(out, op.as<ops::Times>().i_reg);
+				break;
+			case OpCode::Try:
+				put(out, pc(op.as<ops::Try>().handler_pc));
+				break;
+			default:
+				if (op.is<ops::Funcall>()) {
+					const auto &o(op.as<ops::Funcall>());
+					put(out, sym(o.func->id));
+					put(out, o.fimp ? sym(o.fimp->id) : -1);
+					put(out, o.rhs ? lit(*o.rhs) : -1);
+					put(out, o.typed_fimp ? sym(o.typed_fimp->id) : -1);
+				}
+
+				break;
+			}
+		}
+	};
+
+	class BytecodeReader {
+	public:
+		BytecodeReader(string_view in): _in(in) { }
+
+		Int get() {
+			if (_in.size() < sizeof(Int)) { throw Error("Truncated bytecode"); }
+			Int val;
+			memcpy(&val, _in.data(), sizeof(val));
+			_in.remove_prefix(sizeof(val));
+			return val;
+		}
+
+		string_view get_str() {
+			const auto n(get());
+			if (n < 0 || Int(_in.size()) < n) { throw Error("Truncated bytecode"); }
+			const auto val(_in.substr(0, n));
+			_in.remove_prefix(n);
+			return val;
+		}
+
+		void check_header() {
+			if (_in.size() < sizeof(bytecode_magic) ||
+					memcmp(_in.data(), bytecode_magic, sizeof(bytecode_magic))) {
+				throw Error("Invalid bytecode");
+			}
+
+			_in.remove_prefix(sizeof(bytecode_magic));
+			const auto v(get());
+
+			if (v != bytecode_version) {
+				throw Error(fmt("Bytecode version mismatch: %0", {v}));
+			}
+		}
+
+		template <typename T>
+		const T &at(const vector<T> &in, Int i) {
+			if (i < 0 || i >= Int(in.size())) { throw Error("Invalid bytecode index"); }
+			return in[i];
+		}
+	private:
+		string_view _in;
+	};
+
+	void Env::save(ostream &out, Int start_pc, Int end_pc, bool image) const {
+		BytecodeWriter w(*this, start_pc, end_pc);
+		if (image) { for (auto &s: _syms) { w.sym(Sym(&s)); } }
+		const auto &vals(root_scope->_vars);
+
+		for (auto &v: _vars.front()) {
+			const auto slot(v.second);
+			const auto &val((slot < Int(vals.size())) ? vals[slot] : nullopt);
+			w.var(v.first, slot, (image && val) ? &*val : nullptr);
+		}
+
+		if (image) { for (auto &v: _task->_stack) { w.push(v); } }
+		w.write(out, image);
+	}
+
+	void Env::load(string_view in) {
+		struct FimpRec {
+			Sym func;
+			Fimp::Args args;
+			Int start_pc, end_pc, opts, nvars;
+			bool root, pure;
+		};
+
+		struct OpRec {
+			OpCode type, code;
+			Int row, col, next, depth;
+			array<Int, 4> args;
+		};
+
+		BytecodeReader r(in);
+		r.check_header();
+		vector<Sym> syms;
+		for (Int n(r.get()); n > 0; n--) { syms.push_back(sym(string(r.get_str()))); }
+
+		auto get_type([&](Int i) {
+				const auto id(r.at(syms, i));
+				const auto t(_lib->get_type(id));
+				if (!t) { throw Error(fmt("Unknown type: %0", {id})); }
+				return *t;
+			});
+
+		const Int start_pc(_ops.size());
+		vector<Box> lits;
+		vector<pair<LambdaPtr, Int>> lambdas;
+
+		for (Int n(r.get()); n > 0; n--) {
+			const auto t(get_type(r.get()));
+
+			if (!r.get()) {
+				lits.emplace_back(t);
+			} else if (t == bool_type) {
+				lits.emplace_back(bool_type, r.get() != 0);
+			} else if (t == char_type) {
+				lits.emplace_back(char_type, Char(r.get()));
+			} else if (t == float_type) {
+				const Int v(r.get());
+				Float f;
+				memcpy(&f, &v, sizeof(f));
+				lits.emplace_back(float_type, f);
+			} else if (t == int_type) {
+				lits.emplace_back(int_type, r.get());
+			} else if (t == lambda_type) {
+				const auto start(r.get()), end(r.get()), opts(r.get()), nvars(r.get());
+				const bool root(r.get());
+				
+				auto l(make_shared<Lambda>(root ? root_scope : nullptr,
+																	 nullptr, start_pc+end,
+																	 Target::Opts(opts), nvars));
+				
+				lambdas.emplace_back(l, start);
+				lits.emplace_back(lambda_type, l);
+			} else if (t == meta_type) {
+				lits.emplace_back(meta_type, get_type(r.get()));
+			} else if (t == nil_type) {
+				lits.emplace_back(nil_type, nullptr);
+			} else if (t == stack_type) {
+				auto s(make_shared<Stack>());
+				for (Int i(r.get()); i > 0; i--) { s->push_back(r.at(lits, r.get())); }
+				lits.emplace_back(stack_type, s);
+			} else if (t == str_type) {
+				lits.emplace_back(str_type, make_shared<Str>(r.get_str()));
+			} else if (t == sym_type) {
+				lits.emplace_back(sym_type, r.at(syms, r.get()));
+			} else if (t == time_type) {
+				lits.emplace_back(time_type, Time(r.get()));
+			} else {
+				throw Error(fmt("Literal not serializable: %0", {t->id}));
+			}
+		}
+
+		vector<FimpRec> fimp_recs;
+
+		for (Int n(r.get()); n > 0; n--) {
+			const auto func(r.at(syms, r.get()));
+			Fimp::Args args;
+			for (Int i(r.get()); i > 0; i--) { args.push_back(r.at(lits, r.get())); }
+			const auto start_pc(r.get()), end_pc(r.get()), opts(r.get()), nvars(r.get());
+			const bool root(r.get()), pure(r.get());
+			fimp_recs.push_back({func, args, start_pc, end_pc, opts, nvars, root, pure});
+		}
+
+		vector<OpRec> op_recs;
+
+		for (Int n(r.get()); n > 0; n--) {
+			const auto type(OpCode(r.get())), code(OpCode(r.get()));
+			const auto row(r.get()), col(r.get()), next(r.get()), depth(r.get());
+			const auto nargs(op_nargs(type));
+			if (nargs == -1) { throw Error(fmt("Invalid op: %0", {Int(type)})); }
+			OpRec rec{type, code, row, col, next, depth, {-1, -1, -1, -1}};
+			for (Int i(0); i < nargs; i++) { rec.args[i] = r.get(); }
+			op_recs.push_back(rec);
+		}
+
+		vector<tuple<Sym, Int, Int>> vars;
+
+		for (Int n(r.get()); n > 0; n--) {
+			const auto id(r.at(syms, r.get()));
+			const auto slot(r.get()), val(r.get());
+			if (val != -1) { r.at(lits, val); }
+			vars.emplace_back(id, slot, val);
+		}
+
+		vector<Box> stack;
+		const bool image(r.get());
+
+		if (image) {
+			if (!_ops.empty()) { throw Error("Images require a fresh env"); }
+			for (Int n(r.get()); n > 0; n--) { stack.push_back(r.at(lits, r.get())); }
+		}
+
+		// Saved root slots are relocated into this env's root vars
+		
+		sort(vars.begin(), vars.end(),
+				 [](auto &x, auto &y) { return get<1>(x) < get<1>(y); });
+
+		auto &root_vars(_vars.front());
+		unordered_map<Int, Int> root_slots;
+
+		for (auto &v: vars) {
+			const auto id(get<0>(v));
+			root_slots.emplace(get<1>(v), root_vars.emplace(id, root_vars.size()).first->second);
+		}
+
+		auto root_slot([&](Int slot) {
+				const auto found(root_slots.find(slot));
+				if (found == root_slots.end()) { throw Error("Invalid bytecode var"); }
+				return found->second;
+			});
+
+		// Var depth of each op, root vars are referenced at depth == level
+		
+		vector<Int> levels(op_recs.size()+1, 0);
+
+		auto nest([&](Int start, Int end) {
+				if (start < 0 || end > Int(op_recs.size()) || start > end) {
+					throw Error("Invalid bytecode range");
+				}
+
+				levels[start]++;
+				levels[end]--;
+			});
+		
+		for (auto &fr: fimp_recs) { nest(fr.start_pc, fr.end_pc); }
+
+		for (auto &rec: op_recs) {
+			if (rec.type == OpCode::Lambda) { nest(rec.args[0], rec.args[1]); }
+		}
+
+		for (Int i(1); i < Int(levels.size()); i++) { levels[i] += levels[i-1]; }
+		
+		vector<FimpPtr> fimps;
+
+		for (auto &fr: fimp_recs) {
+			auto fip(_lib->add_fimp(fr.func, fr.args, Fimp::Imp()));
+			auto &fi(*fip);
+			fi._end_pc = start_pc+fr.end_pc;
+			fi._opts = Target::Opts(fr.opts);
+			fi._nvars = fr.nvars;
+			if (fr.root) { fi._parent_scope = root_scope; }
+			fi.pure = fr.pure;
+			fimps.push_back(fip);
+		}
+
+		auto get_func([&](Int i) {
+				const auto id(r.at(syms, i));
+				const auto f(_lib->get_func(id));
+				if (!f) { throw Error(fmt("Unknown func: %0", {id})); }
+				return *f;
+			});
+
+		auto get_fimp([&](const Func &fn, Int i) {
+				const auto id(r.at(syms, i));
+				const auto f(fn.get_fimp(id));
+				if (!f) { throw Error(fmt("Unknown fimp: %0", {id})); }
+				return *f;
+			});
+
+		for (Int i(0); i < Int(op_recs.size()); i++) {
+			const auto &rec(op_recs[i]);
+			const Pos pos(rec.row, rec.col);
+			const auto &a(rec.args);
+			Op *op(nullptr);
+
+			switch (rec.type) {
+			case OpCode::Call:
+				op = &emit(ops::Call::type, pos);
+				break;
+			case OpCode::Case:
+				op = &emit(ops::Case::type, pos, r.at(lits, a[0]), start_pc+a[1]);
+				break;
+			case OpCode::CaseDrop:
+				op = &emit(ops::CaseDrop::type, pos, r.at(lits, a[0]), start_pc+a[1]);
+				break;
+			case OpCode::DDrop:
+				op = &emit(ops::DDrop::type, pos);
+				break;
+			case OpCode::Drop:
+				op = &emit(ops::Drop::type, pos);
+				break;
+			case OpCode::Dup:
+				op = &emit(ops::Dup::type, pos);
+				break;
+			case OpCode::Else:
+				op = &emit(ops::Else::type, pos, start_pc+a[0]);
+				break;
+			case OpCode::Eqval:
+				op = &emit(ops::Eqval::type, pos,
+									 (a[0] == -1)
+									 ? optional<const Box>()
+									 : optional<const Box>(r.at(lits, a[0])));
+				break;
+			case OpCode::Fimp:
+				op = &emit(ops::Fimp::type, pos, r.at(fimps, a[0]));
+				break;
+			case OpCode::GetSlot:
+				op = &emit(ops::GetSlot::type, pos, r.at(syms, a[0]), a[1],
+									 (a[1] == levels[i]) ? root_slot(a[2]) : a[2]);
+				break;
+			case OpCode::Isa:
+				op = &emit(ops::Isa::type, pos, get_type(a[0]));
+				break;
+			case OpCode::Jump:
+				op = &emit(ops::Jump::type, pos, start_pc+a[0]);
+				break;
+			case OpCode::JumpIf:
+				op = &emit(ops::JumpIf::type, pos, a[0]);
+				op->as<ops::JumpIf>().end_pc = start_pc+a[1];
+				break;
+			case OpCode::Lambda: {
+				op = &emit(ops::Lambda::type, pos);
+				auto &o(op->as<ops::Lambda>());
+				o.end_pc = start_pc+a[1];
+				o.opts = Target::Opts(a[2]);
+				o.nvars = a[3];
+				break;
+			}
+			case OpCode::LetSlot:
+				op = &emit(ops::LetSlot::type, pos, r.at(syms, a[0]),
+									 levels[i] ? a[1] : root_slot(a[1]));
+				break;
+			case OpCode::Nop:
+				op = &emit(ops::Nop::type, pos);
+				break;
+			case OpCode::Push:
+				op = &emit(ops::Push::type, pos, r.at(lits, a[0]));
+				break;
+			case OpCode::Recall:
+				op = &emit(ops::Recall::type, pos);
+				break;
+			case OpCode::Return:
+				op = &emit(ops::Return::type, pos);
+				break;
+			case OpCode::Rot:
+				op = &emit(ops::Rot::type, pos);
+				break;
+			case OpCode::RSwap:
+				op = &emit(ops::RSwap::type, pos);
+				break;
+			case OpCode::SDrop:
+				op = &emit(ops::SDrop::type, pos);
+				break;
+			case OpCode::Split:
+				op = &emit(ops::Split::type, pos);
+				break;
+			case OpCode::SplitEnd:
+				op = &emit(ops::SplitEnd::type, pos);
+				break;
+			case OpCode::Stack:
+				op = &emit(ops::Stack::type, pos, a[0] != 0);
+				break;
+			case OpCode::Swap:
+				op = &emit(ops::Swap::type, pos);
+				break;
+			case OpCode::Times:
+				op = &emit(ops::Times::type, pos, a[0]);
+				break;
+			case OpCode::Try:
+				op = &emit(ops::Try::type, pos);
+				op->as<ops::Try>().handler_pc = start_pc+a[0];
+				break;
+			case OpCode::TryEnd:
+				op = &emit(ops::TryEnd::type, pos);
+				break;
+			default: {
+				const auto &type(funcall_type(rec.type));
+				const auto &fn(get_func(a[0]));
+
+				if (a[1] != -1) {
+					op = &emit(type, pos, get_fimp(*fn, a[1]));
+				} else if (a[2] != -1) {
+					op = &emit(type, pos, fn, r.at(lits, a[2]));
+				} else {
+					op = &emit(type, pos, fn);
+				}
+
+				if (a[3] != -1) {
+					auto &o(op->as<ops::Funcall>());
+					o.typed_fimp = get_fimp(*fn, a[3]);
+					o.typed_version = fn->version();
+				}
+
+				break;
+			}
+			}
+
+			op->code = rec.code;
+			op->depth = rec.depth;
+		}
+
+		const Int end_pc(_ops.size());
+
+		auto get_pc([&](Int pc) {
+				return (pc < 0 || start_pc+pc >= end_pc) ? nullptr : &_ops[start_pc+pc];
+			});
+
+		for (Int i(0); i < Int(op_recs.size()); i++) {
+			auto &op(_ops[start_pc+i]);
+			op.next = get_pc(op_recs[i].next);
+
+			if (op_recs[i].type == OpCode::Lambda) {
+				op.as<ops::Lambda>().start_pc = get_pc(op_recs[i].args[0]);
+			}
+		}
+
+		for (Int i(0); i < Int(fimps.size()); i++) {
+			fimps[i]->_start_pc = get_pc(fimp_recs[i].start_pc);
+		}
+
+		for (auto &l: lambdas) { l.first->_start_pc = get_pc(l.second); }
+
+		link(start_pc, end_pc);
+
+		for (auto &v: vars) {
+			const auto val(get<2>(v));
+			if (val != -1) { root_scope->let(get<0>(v), root_slot(get<1>(v)), lits[val]); }
+		}
+
+		for (auto &v: stack) { _task->_stack.push_back(v); }
+	}
+
+	void Env::load_file(const string &path) {
+		const MappedFile f(path);
+		load(f.view());
+	}
+
+	static uint64_t bytecode_hash(string_view in) {
+		uint64_t h(14695981039346656037ULL ^ uint64_t(bytecode_version));
+
+		for (auto c: in) {
+			h ^= static_cast<unsigned char>(c);
+			h *= 1099511628211ULL;
+		}
+
+		return h;
+	}
+
+	void Env::compile_cached(const string &path, const string &cache_dir) {
+		const MappedFile f(path);
+		const auto src(f.view());
+
+		/* Compiled code depends on the fimps in scope (int ops, typed calls and
+			 folding), root var slots and peephole; entries are summed since map
+			 order varies between runs. */
+		
+		uint64_t env_hash(peephole);
+
+		for (auto &fp: _lib->funcs()) {
+			for (auto &fip: fp.second->fimps()) {
+				const auto &fi(*fip.second);
+				env_hash += bytecode_hash(fmt("%0 %1 %2", {fi.id, bool(fi.imp), fi.pure}));
+			}
+		}
+
+		for (auto &v: _vars.front()) {
+			env_hash += bytecode_hash(fmt("@%0 %1", {v.first, v.second}));
+		}
+		
+		stringstream key;
+		key << hex << setw(16) << setfill('0') << (bytecode_hash(src) ^ env_hash);
+		const auto cache_path(cache_dir + '/' + key.str() + ".sbc");
+
+		if (access(cache_path.c_str(), R_OK) == 0) {
+			load_file(cache_path);
+			return;
+		}
+
+		const Int start_pc(_ops.size());
+		compile(src);
+		const auto tmp_path(fmt("%0.%1", {cache_path, Int(getpid())}));
+		ofstream out(tmp_path, ios::binary);
+		if (out.fail()) { return; }
+		save(out, start_pc, _ops.size());
+		out.close();
+		if (out.fail() || rename(tmp_path.c_str(), cache_path.c_str())) { remove(tmp_path.c_str()); }
+	}
+}
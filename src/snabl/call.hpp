@@ -7,17 +7,25 @@
 #include "snabl/std.hpp"
 
 namespace snabl {	
+	class Target;
+	
 	struct Call {
-		const TargetPtr target;
+		Target &target;
 		const Pos pos;
-		const State state;
 		const PC return_pc;
+		const bool split;
+		const TargetPtr owner;
+		const optional<State> state;
 
 		Call(Env &env,
-				 const TargetPtr &target,
+				 Target &target,
 				 Pos pos,
-				 PC return_pc=nullptr):
-			target(target), pos(pos), state(env), return_pc(return_pc) { }
+				 PC return_pc,
+				 bool split,
+				 const TargetPtr &owner,
+				 bool recalls):
+			target(target), pos(pos), return_pc(return_pc), split(split), owner(owner),
+			state(recalls ? optional<State>(in_place, env) : nullopt) { }
 	};
 }
 
@@ -1,19 +1,52 @@
 #include <ctype.h>
 
 #include "snabl/env.hpp"
+#include "snabl/mapped_file.hpp"
 #include "snabl/parser.hpp"
 
 namespace snabl {
 	void Env::compile(string_view in) {
-		const string s(in);
-		istringstream ss(s);
-		compile(ss);
+		Arena arena(in.size()*Parser::arena_ratio);
+		Forms forms;
+		Parser(*this, arena).parse(in, forms);		
+		const Int start_pc(_ops.size());
+		compile(forms);
+		const Int end_pc(_ops.size());
+
+		// Fimp bodies were already processed by Fimp::compile
+		
+		vector<pair<Int, Int>> segs;
+		Int seg_start(start_pc);
+
+		for (Int pc(start_pc); pc < end_pc;) {
+			const auto &op(_ops[pc++]);
+			
+			if (op.type.code == OpCode::Fimp) {
+				segs.emplace_back(seg_start, pc);
+				pc = seg_start = max(pc, op.as<ops::Fimp>().ptr->end_pc());
+			}
+		}
+
+		if (seg_start < end_pc) { segs.emplace_back(seg_start, end_pc); }
+		
+		for (auto &s: segs) {
+			if (peephole) { optimize(s.first, s.second); }
+			tail_calls(s.first, s.second);
+		}
+		
+		infer(start_pc, end_pc);
+		for (auto &s: segs) { link(s.first, s.second); }
 	}
 
 	void Env::compile(istream &in) {
-		Forms forms;
-		Parser(*this).parse(in, forms);		
-		compile(forms);
+		stringstream buf;
+		buf << in.rdbuf();
+		compile(string_view(buf.str()));
+	}
+
+	void Env::compile_file(const string &path) {
+		const MappedFile f(path);
+		compile(f.view());
 	}
 
 	void Env::emit(Pos pos, FuncPtr &func, FimpPtr &fimp) {		
@@ -22,28 +55,63 @@ namespace snabl {
 			emit(ops::Funcall::type, pos, fimp);
 			fimp = nullptr;
 		} else if (func) {
-			emit(ops::Funcall::type, pos, func);
+			emit(func_op(func), pos, func);
 		}
 
 		func = nullptr;
 	}
+
+	void Env::add_int_op(const FuncPtr &func, const ops::Funcall::Type &type) {
+		const Stack args(func->nargs, Box(int_type));
+		auto fimp(func->get_best_fimp(args.data(), args.data()+args.size()));
+		assert(fimp);
+		_func_ops.emplace(func.get(),
+											FuncOp{*fimp, &type, func->version(), true, true});
+	}
+
+	void Env::add_func_op(const FuncPtr &func, const ops::Funcall::Type &type) {
+		_func_ops.emplace(func.get(),
+											FuncOp{func->get_fimp(), &type, func->version(), false, true});
+	}
+
+	const ops::Funcall::Type &Env::func_op(const FuncPtr &func) {
+		const auto found(_func_ops.find(func.get()));
+		if (found == _func_ops.end()) { return ops::Funcall::type; }
+		auto &fo(found->second);
+
+		if (fo.version != func->version()) {
+			if (fo.ints) {
+				const Stack args(func->nargs, Box(int_type));
+				const auto fimp(func->get_best_fimp(args.data(), args.data()+args.size()));
+				fo.match = fimp && *fimp == fo.fimp;
+			} else {
+				fo.match = false;
+			}
+			
+			fo.version = func->version();
+		}
+		
+		return fo.match ? *fo.type : ops::Funcall::type;
+	}
+	
+	void Env::call_overflow(Pos pos) {
+		throw RuntimeError(*this, pos, fmt("Call stack overflow: %0", {max_calls}));
+	}
 	
 	void Env::compile(const Forms &forms) { compile(forms.begin(), forms.end()); }
 	
 	void Env::compile(const Form &form) {
-		Forms fs {form};
-		auto i(fs.cbegin());
+		auto i(&form);
 		FuncPtr func;
 		FimpPtr fimp;
 
-		i->imp->compile(i, i+1, func, fimp, *this);
+		form.imp->compile(i, &form+1, func, fimp, *this);
 		emit(form.pos, func, fimp);
 	}
 
 	void Env::compile(const Form &form, FuncPtr &func, FimpPtr &fimp) {
-		Forms fs {form};
-		auto i(fs.cbegin());
-		i->imp->compile(i, i+1, func, fimp, *this);
+		auto i(&form);
+		form.imp->compile(i, &form+1, func, fimp, *this);
 	}
 
 	void Env::compile(Forms::const_iterator begin, Forms::const_iterator end) {
@@ -55,6 +123,7 @@ namespace snabl {
 	
 	void Env::compile(Forms::const_iterator begin, Forms::const_iterator end,
 										FuncPtr &func, FimpPtr &fimp) {
+		if (begin == end) { return; }
 		for (auto i(begin); i != end;) { i->imp->compile(i, end, func, fimp, *this); }
 		emit(begin->pos, func, fimp);
 	}
@@ -1,6 +1,7 @@
 #ifndef SNABL_ENV_HPP
 #define SNABL_ENV_HPP
 
+#include "snabl/jit.hpp"
 #include "snabl/lib.hpp"
 #include "snabl/libs/home.hpp"
 #include "snabl/pos.hpp"
@@ -32,15 +33,31 @@ namespace snabl {
 	
 	class Env {
 	public:
+		struct InferStats {
+			Int calls, resolved;
+			InferStats(): calls(0), resolved(0) { }
+		};
 	private:
 		list<SymImp> _syms;
-		unordered_map<string, Sym> _sym_table;
+		unordered_map<string_view, Sym> _sym_table;
 		Int _type_tag;
 		TaskPtr _task;
 		ScopePtr _scope;
-		Stack _stack;
+		FimpCache::Stats _fimp_cache_stats;
+		InferStats _infer_stats;
+		struct FuncOp {
+			FimpPtr fimp;
+			const ops::Funcall::Type *type;
+			Int version;
+			bool ints, match;
+		};
+		
+		unordered_map<const Func *, FuncOp> _func_ops;
 	public:
+		const Sym dots_sym, pipe_sym;
 		set<char> separators;
+		bool jit, peephole;
+		Int jit_threshold, max_calls, max_error_items;
 
 		TraitPtr root_type, maybe_type, no_type, num_type, seq_type, sink_type, 
 			source_type;
@@ -64,20 +81,30 @@ namespace snabl {
 		
 		Env():
 			_type_tag(1),
+			dots_sym(sym("..")),
+			pipe_sym(sym("|")),
 			separators({
 					' ', '\t', '\n', ',', ';', '?', '.', '|',
 						'<', '>', '(', ')', '{', '}', '[', ']'
 						}),
+			jit(false),
+			peephole(true),
+			jit_threshold(100),
+			max_calls(100000),
+			max_error_items(16),
 			home_lib(*this),
 			root_scope(begin_scope()),
 			_lib(&home_lib),
-			_stack_offs(0) {
+			_stack_offs(0),
+			_jit(*this) {
 			add_special_char('t', 8);
 			add_special_char('n', 10);
 			add_special_char('r', 13);
 			add_special_char('e', 27);
 			add_special_char('s', 32);
 			begin_regs();
+			begin_vars();
+			begin_opts();
 			_task = start_task();
 		}
 
@@ -101,56 +128,118 @@ namespace snabl {
 			return (found == _char_specials.end()) ? nullopt : make_optional(found->second);
 		}
 		
-		Sym sym(const string &name) {
+		Sym sym(string_view name) {
 			const auto found(_sym_table.find(name));
 			if (found != _sym_table.end()) { return found->second; }
 			_syms.emplace_back(name);
 			const auto imp(&_syms.back());
-			return _sym_table.emplace(name, Sym(imp)).first->second;
+			return _sym_table.emplace(imp->name, Sym(imp)).first->second;
 		}
 
-		void begin_regs() { _nregs.push_back(0); }
+		void begin_regs() { _nregs.emplace_back(0, 0); }
 		
 		Int end_regs() {
-			const Int n(_nregs.back());
+			const Int n(_nregs.back().second);
 			_nregs.pop_back();
 			return n;
 		}
 
 		Int begin_reg() {
 			auto &n(_nregs.back());
-			assert(n < Scope::MaxRegs);
-			return n++;
+			n.second = max(n.second, n.first+1);
+			return n.first++;
 		}
 		
 		void end_reg(Int idx) {
-			assert(Int(_nregs.back()) == idx+1);
-			_nregs.back()--;
+			assert(_nregs.back().first == idx+1);
+			_nregs.back().first--;
+		}
+
+		void begin_vars() { _vars.emplace_back(); }
+
+		void begin_opts() { _opts.push_back(Target::Opts::None); }
+
+		Target::Opts end_opts() {
+			const auto opts(_opts.back());
+			_opts.pop_back();
+			if (!_opts.empty()) { _opts.back() |= opts; }
+			return opts;
+		}
+
+		Int end_vars() {
+			const Int n(_vars.back().size());
+			_vars.pop_back();
+			return n;
+		}
+
+		Int var_depth() const { return _vars.size(); }
+
+		Int let_var(Sym id) {
+			auto &vs(_vars.back());
+			return vs.emplace(id, vs.size()).first->second;
 		}
 
+		optional<pair<Int, Int>> get_var(Sym id) const {
+			Int depth(0);
+			
+			for (auto vs(_vars.rbegin()); vs != _vars.rend(); vs++, depth++) {
+				const auto found(vs->find(id));
+				if (found != vs->end()) { return make_pair(depth, found->second); }
+			}
+
+			return nullopt;
+		}
+		
 		template <typename T>
-		T &get_reg(Int idx) { return any_cast<T &>(_scope->_regs[idx]); }
+		T &get_reg(Int idx) { return any_cast<T &>(_scope->_regs.at(idx)); }
 
 		template <typename T>
 		const T &get_reg(Int idx) const {
-			return any_cast<const T &>(_scope->_regs[idx]);
+			return any_cast<const T &>(_scope->_regs.at(idx));
 		}
 
-		void let_reg(Int idx, any &&val) { _scope->_regs[idx] = move(val); }
-		void clear_reg(Int idx) const { _scope->_regs[idx].reset(); }
+		void let_reg(Int idx, any &&val) {
+			auto &rs(_scope->_regs);
+			if (idx >= Int(rs.size())) { rs.resize(idx+1); }
+			rs[idx] = move(val);
+		}
+		void clear_reg(Int idx) const { _scope->_regs.at(idx).reset(); }
 		
 		template <typename ImpT, typename... ArgsT>
 		Op &emit(const OpType<ImpT> &type, ArgsT &&... args) {
 		  Op *prev(_ops.empty() ? nullptr : &_ops.back());
-			_ops.emplace_back(*this, type, args...);
+
+			if constexpr (is_same_v<ImpT, ops::GetSlot> || is_same_v<ImpT, ops::LetSlot>) {
+				_opts.back() |= Target::Opts::Vars;
+			} else if constexpr (is_same_v<ImpT, ops::Recall>) {
+				_opts.back() |= Target::Opts::Recalls;
+			} else if constexpr (is_same_v<ImpT, ops::Fimp> || is_same_v<ImpT, ops::Lambda>) {
+				_opts.back() |= Target::Opts::Escapes;
+			}
+			
+			_ops.emplace_back(type, args...);
 			auto &op(_ops.back());
-			if (prev) { prev->next = op.imp; }
+			if (prev) { prev->next = &op; }
+			for (auto o: _unlinked) { o->branch = &op; }
+			_unlinked.clear();
 			return op;
 		}
 
+		template <typename ImpT, typename... ArgsT>
+		Op &replace(Op &op, const OpType<ImpT> &type, Pos pos, ArgsT &&... args) {
+			const auto next(op.next);
+			op.~Op();
+			auto &new_op(*new (&op) Op(type, pos, forward<ArgsT>(args)...));
+			new_op.next = next;
+			return new_op;
+		}
+
 		void emit(Pos pos, FuncPtr &func, FimpPtr &fimp);
+		void add_int_op(const FuncPtr &func, const ops::Funcall::Type &type);
+		void add_func_op(const FuncPtr &func, const ops::Funcall::Type &type);
 
 		void compile(string_view in);
+		void compile_file(const string &path);
 		void compile(istream &in);
 		void compile(const Forms &forms);
 		void compile(const Form &form);
@@ -158,6 +247,18 @@ namespace snabl {
 		void compile(Forms::const_iterator begin, Forms::const_iterator end);
 		void compile(Forms::const_iterator begin, Forms::const_iterator end,
 								 FuncPtr &func, FimpPtr &fimp);
+
+		void infer(Int start_pc, Int end_pc, const vector<const AType *> &entry={});
+		void optimize(Int start_pc, Int end_pc);
+		void tail_calls(Int start_pc, Int end_pc);
+		void link(Int start_pc, Int end_pc);
+		vector<Int> live_ops(Int start_pc, Int end_pc) const;
+
+		void save(ostream &out, Int start_pc, Int end_pc, bool image=false) const;
+		void save_image(ostream &out) const { save(out, 0, _ops.size(), true); }
+		void load(string_view in);
+		void load_file(const string &path);
+		void compile_cached(const string &path, const string &cache_dir);
 		
 		void run(string_view in);
 		void run(istream &in);
@@ -169,11 +270,29 @@ namespace snabl {
 		
 		TaskPtr start_task() { return make_shared<Task>(_task); }
 		
-		const ScopePtr &begin_scope(const ScopePtr &parent=nullptr) {
-			_scope = make_shared<Scope>(_scope, parent);
+		const ScopePtr &begin_scope(const ScopePtr &parent=nullptr, Int nvars=0) {
+			_scope = make_shared<Scope>(_scope, parent, nvars);
+			return _scope;
+		}
+
+		const ScopePtr &begin_frame(const ScopePtr &parent, Int nvars) {
+			auto &fs(_task->_frames);
+			auto &n(_task->_nframes);
+			if (n == Int(fs.size())) { fs.emplace_back(nullptr, nullptr); }
+			auto &f(fs[n++]);
+			f.reset(_scope, parent, nvars);
+			_scope = ScopePtr(ScopePtr(), &f);
 			return _scope;
 		}
 
+		void begin_scope(const Target &target) {
+			if (target._opts & Target::Opts::Escapes) {
+				begin_scope(target._parent_scope, target._nvars);
+			} else {
+				begin_frame(target._parent_scope, target._nvars);
+			}
+		}
+		
 		const ScopePtr &scope() const { return _scope; }
 
 		void end_scope() {
@@ -182,16 +301,43 @@ namespace snabl {
 			_scope = prev;
 		}
 
-		void jump(const OpImp &pc) { _task->_pc = pc ? &pc : nullptr; }
+		void end_frame() {
+			auto &f(*_scope);
+			_scope = f.prev;
+			f.reset(nullptr, nullptr, 0);
+			_task->_nframes--;
+		}
+
+		void end_scope(const Target &target) {
+			if (target._opts & Target::Opts::Escapes) {
+				end_scope();
+			} else {
+				end_frame();
+			}
+		}
 
 		void jump(PC pc) { _task->_pc = pc; }
 
 		void jump(Int pc) {
-			_task->_pc = (pc == Int(_ops.size())) ? nullptr : &(_ops.begin()+pc)->imp;
+			_task->_pc = (pc == Int(_ops.size())) ? nullptr : &_ops[pc];
 		}
 
-		void begin_call(const TargetPtr &target, Pos pos, PC return_pc) {
-			_task->_calls.emplace_back(*this, target, pos, return_pc);
+		void enter(Target &target) {
+			jump(target._start_pc);
+			if (!jit) { return; }
+
+			if (!target._jit_fn && ++target._ncalls == jit_threshold) {
+				target._jit_fn = _jit.compile(target);
+			}
+
+			if (target._jit_fn) { _task->_pc = _jit.call(target._jit_fn, _task->_stack); }
+		}
+
+		void begin_call(Target &target, Pos pos, PC return_pc,
+										bool split=false, const TargetPtr &owner=nullptr) {
+			if (_task->_calls.size() == max_calls) { call_overflow(pos); }
+			_task->_calls.emplace_back(*this, target, pos, return_pc, split, owner,
+																 target._opts & Target::Opts::Recalls);
 		}
 		
 		const Call &call() const { return _task->_calls.back(); }
@@ -202,8 +348,9 @@ namespace snabl {
 			if (!calls.size()) { throw RuntimeError(*this, pos, "Nothing to recall"); }
 
 			const auto &c(calls.back());
-			const auto &t(*c.target);
-			const auto &s(c.state);
+			if (!c.state) { throw RuntimeError(*this, pos, "Nothing to recall"); }
+			const auto &t(c.target);
+			const auto &s(*c.state);
 			
 			s.restore_lib(*this);
 			s.restore_scope(*this);
@@ -211,7 +358,7 @@ namespace snabl {
 			s.restore_splits(*this);
 			
 			if (t.opts() & Target::Opts::Vars) { _scope->clear_vars(); }
-			jump(&t.start_pc());
+			jump(t.start_pc());
 		}
 
 		void _return(Pos pos) {
@@ -219,40 +366,45 @@ namespace snabl {
 			if (!calls.size()) { throw RuntimeError(*this, pos, "Nothing to return from"); }
 			auto &c(calls.back());
 			const auto &t(c.target);
-			if (t->_parent_scope) { end_scope(); }
+			if (t._parent_scope) { end_scope(t); }
 			_task->_pc = c.return_pc;
-			auto fi(dynamic_cast<Fimp *>(t.get()));
-			if (fi && !fi->imp) { end_split(); }
+			if (c.split) { end_split(); }
 			end_call();
 		}
 		
-		void begin_try(ops::Try &op) { _task->_tries.push_back(&op); }
-		ops::Try *current_try() { return _task->_tries.back(); }
+		void begin_try(const Op &op) { _task->_tries.emplace_back(op, *this); }
 		void end_try() { _task->_tries.pop_back(); }
 
-		void push(const Box &val) { _stack.push_back(val); }
+		void push(const Box &val) { _task->_stack.push_back(val); }
 
 		template <typename ValT, typename... ArgsT>
 		void push(const TypePtr<ValT> &type, ArgsT &&...args) {
-			_stack.emplace_back(type, ValT(forward<ArgsT>(args)...));
+			_task->_stack.emplace_back(type, ValT(forward<ArgsT>(args)...));
 		}
 
 		Box &peek() {
-			if (Int(_stack.size()) <= _stack_offs) { throw Error("Nothing to peek"); }
-			return _stack.back();
+			if (Int(_task->_stack.size()) <= _stack_offs) { throw Error("Nothing to peek"); }
+			return _task->_stack.back();
 		}
 
 		Box pop() {
-			if (Int(_stack.size()) <= _stack_offs) { throw Error("Nothing to pop"); }
-			Box v(_stack.back());
-			_stack.pop_back();
+			if (Int(_task->_stack.size()) <= _stack_offs) { throw Error("Nothing to pop"); }
+			Box v(_task->_stack.back());
+			_task->_stack.pop_back();
 			return v;
 		}
 
-		const Stack &stack() { return _stack; }
+		const ValStack &stack() const { return _task->_stack; }
+
+		const FimpCache::Stats &fimp_cache_stats() const {
+			return _fimp_cache_stats;
+		}
+
+		const InferStats &infer_stats() const { return _infer_stats; }
+		const Jit::Stats &jit_stats() const { return _jit.stats(); }
 
 		void begin_split(Int offs=0) {
-			_stack_offs = _stack.size()-offs;
+			_stack_offs = _task->_stack.size()-offs;
 			_task->_splits.push_back(_stack_offs);
 		}
 
@@ -276,37 +428,38 @@ namespace snabl {
 	private:
 		map<char, Char> _special_chars;
 		map<Char, char> _char_specials;
-		vector<Int> _nregs;
+		vector<pair<Int, Int>> _nregs;
+		vector<unordered_map<Sym, Int>> _vars;
+		vector<Target::Opts> _opts;
 		Ops _ops;
+		vector<Op *> _unlinked;
+		deque<FimpCache> _fimp_caches;
 		
 		Lib *_lib;
 		Int _stack_offs;
+		Jit _jit;
+
+		const ops::Funcall::Type &func_op(const FuncPtr &func);
+		bool check_func_op(Op &op);
+		[[noreturn]] void call_overflow(Pos pos);
+		const FimpPtr &get_fimp(ops::Funcall &op, Pos pos);
+		bool catch_error(const ErrorPtr &e);
+		optional<Box> eval(const FimpPtr &fimp, const Stack &args, Pos pos);
+
+		Int op_index(PC op, Int start_pc, Int end_pc) const {
+			const auto pc(op ? _ops.index_of(op) : -1);
+			return (pc >= start_pc && pc < end_pc) ? pc : -1;
+		}
 		
 		friend RuntimeError;
 		friend State;
 		friend Target;
-		friend ops::DDrop::Type;
-		friend ops::Drop::Type;
-		friend ops::Dup::Type;
-		friend ops::Eqval::Type;
-		friend ops::Fimp::Type;
-		friend ops::Funcall::Type;
-		friend ops::Isa::Type;
-		friend ops::Let::Type;
-		friend ops::Recall::Type;
-		friend ops::Return::Type;
-		friend ops::Rot::Type;
-		friend ops::RSwap::Type;
-		friend ops::SDrop::Type;
-		friend ops::Stack::Type;
-		friend ops::Swap::Type;
-		friend ops::Try::Type;
-		friend ops::TryEnd::Type;
 	};
 
 	inline bool Box::isa(const ATypePtr &rhs) const {
-		auto &lhs((_type == _type->lib.env.meta_type) ? as<ATypePtr>() : _type);
-		return lhs->isa(rhs);
+		auto t(type());
+		auto lhs((t == t->lib.env.meta_type.get()) ? as<ATypePtr>().get() : t);
+		return lhs->isa(rhs.get());
 	}
 
 	template <typename ValT, typename... ArgsT>
@@ -32,25 +32,53 @@ namespace snabl {
 		auto &fi(*fip);
 		if (fi._start_pc) { return false; }
 		auto &env(fi.func->lib.env);
+
+		if (!fi.form) {
+			throw CompileError(pos, fmt("Failed compiling: %0", {fi.id}));
+		}
+		
 		auto &start_op(env.emit(ops::Fimp::type, pos, fip));
 		env.begin_regs();
+		env.begin_vars();
+		env.begin_opts();
 		const auto offs(env.ops().size());
-		env.compile(*fi.form);
-		if (env.end_regs()) { fi._opts |= Opts::Regs; }
 
-		for (auto op(env.ops().begin()+offs);
-				 op != env.ops().end();
-				 op++) {
-			if (&op->type == &ops::Get::type || &op->type == &ops::Let::type) {
-				fi._opts |= Opts::Vars;
-			}
+		try {
+			env.compile(*fi.form);
+		} catch (...) {
+			fi.form.reset();
+			env.end_regs();
+			env.end_vars();
+			env.end_opts();
+			throw;
+		}
+		
+		fi.form.reset();
+		if (env.end_regs()) { fi._opts |= Opts::Regs; }
+		fi._nvars = env.end_vars();
+		fi._opts |= env.end_opts();
 
-			if (&op->type == &ops::Recall::type) { fi._opts |= Opts::Recalls; }
+		if (env.var_depth() == 1 &&
+				(fi._opts & Opts::Regs || fi._opts & Opts::Vars)) {
+			fi._parent_scope = env.root_scope;
 		}
 		
 		env.emit(ops::Return::type, pos);
+		const Int end_pc(env.ops().size());
 		fi._start_pc = start_op.next;
-		fi._end_pc = env.ops().size();
+		fi._end_pc = end_pc;
+		if (env.peephole) { env.optimize(offs, end_pc); }
+		env.tail_calls(offs, end_pc);
+
+		vector<const AType *> args;
+		
+		for (auto &a: fi.args) {
+			const auto t(a.type());
+			args.push_back(t->child_types().empty() ? t : nullptr);
+		}
+		
+		env.infer(offs, end_pc, args);
+		env.link(offs, end_pc);
 		return true;
 	}
 
@@ -60,35 +88,36 @@ namespace snabl {
 		auto &env(fn.lib.env);
 		
 		if (fi.imp) {
-			env.begin_call(fip, pos, env.pc());
+			env.begin_call(fi, pos, env.pc());
 			fi.imp(fi);
 			env.end_call();
 		} else {
 			Fimp::compile(fip, pos);
-			if (fi._parent_scope) { env.begin_scope(fi._parent_scope); }
+			if (fi._parent_scope) { env.begin_scope(fi); }
 			env.begin_split(fn.nargs);		
-			env.begin_call(fip, pos, env.pc());
-			env.jump(&fi._start_pc);
+			env.begin_call(fi, pos, env.pc(), true);
+			env.enter(fi);
 		}
 	}
 
 	Fimp::Fimp(const FuncPtr &func, const Args &args, Imp imp):
-		Def(get_id(*func, args)), func(func), args(args), imp(imp) { }
+		Def(get_id(*func, args)), func(func), args(args), imp(imp), pure(false) { }
 
 	Fimp::Fimp(const FuncPtr &func, const Args &args, const Form &form):
-		Def(get_id(*func, args)), func(func), args(args), form(form) { }
+		Def(get_id(*func, args)), func(func), args(args), form(form), pure(false) { }
 
-	Int Fimp::score(Stack::const_iterator begin, Stack::const_iterator end) const {
+	Int Fimp::score(const Box *begin, const Box *end) const {
 		auto &env(func->lib.env);
-		auto i(begin), j(args.begin());
+		auto i(begin);
+		auto j(args.begin());
 		Int score(0);
 
 		for (; j != args.end(); i++, j++) {
 			if (i == end) { return -1; }
 			
 			auto &iv(*i), &jv(*j);
-			auto &it(iv.type()), &jt(jv.type());
-			if (it == env.no_type) { continue; }
+			auto it(iv.type()), jt(jv.type());
+			if (it == env.no_type.get()) { continue; }
 
 			if (jv.has_val()) {
 				if (!iv.has_val() || !iv.eqval(jv)) { return -1; }
@@ -17,8 +17,9 @@ namespace snabl {
 		
 		const FuncPtr func;
 		const Args args;
-		const optional<Form> form;
+		optional<Form> form;
 		const Imp imp;
+		bool pure;
 
 		static Sym get_id(const Func &func, const Args &args);
 		static bool compile(const FimpPtr &fip, Pos pos);
@@ -29,7 +30,7 @@ namespace snabl {
 
 		string target_id() const override { return id.name(); }		
 
-		Int score(Stack::const_iterator begin, Stack::const_iterator end) const;
+		Int score(const Box *begin, const Box *end) const;
 	private:
 		friend Env;
 		friend ops::Fimp;
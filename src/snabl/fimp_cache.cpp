@@ -0,0 +1,65 @@
+#include "snabl/fimp_cache.hpp"
+#include "snabl/func.hpp"
+
+namespace snabl {
+	FimpCache::Key::Key(const Box *begin, const Box *end):
+		types{} {
+		auto i(types.begin());
+		for (; begin != end; begin++, i++) { *i = begin->type(); }
+	}
+
+	size_t FimpCache::KeyHash::operator ()(const Key &key) const {
+		size_t h(0);
+
+		for (auto t: key.types) {
+			h = h*31 + hash<const AType *>()(t);
+		}
+		
+		return h;
+	}
+
+	FimpCache::FimpCache(): _nentries(0), _version(-1), _megamorphic(false) { }
+
+	const FimpPtr *FimpCache::get(const Func &func,
+																const Box *begin,
+																const Box *end,
+																Stats &stats) {
+		if (!func.is_cacheable()) {
+			stats.misses++;
+			return func.get_best_fimp(begin, end);
+		}
+
+		if (_version != func.version()) {
+			_nentries = 0;
+			_megamorphic = false;
+			_version = func.version();
+		}
+
+		const Key key(begin, end);
+
+		if (_megamorphic) {
+			stats.megamorphic++;
+			return func.get_best_fimp(key, begin, end);
+		}
+		
+		for (Int i(0); i < _nentries; i++) {
+			if (_keys[i] == key) {
+				stats.hits++;
+				return &_fimps[i];
+			}
+		}
+
+		stats.misses++;
+		auto fimp(func.get_best_fimp(key, begin, end));
+		if (!fimp) { return nullptr; }
+
+		if (_nentries == max_entries) {
+			_megamorphic = true;
+		} else {
+			_keys[_nentries] = key;
+			_fimps[_nentries++] = *fimp;
+		}
+		
+		return fimp;
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef SNABL_FIMP_CACHE_HPP
+#define SNABL_FIMP_CACHE_HPP
+
+#include "snabl/ptrs.hpp"
+#include "snabl/stack.hpp"
+#include "snabl/std.hpp"
+
+namespace snabl {
+	class AType;
+	class Func;
+
+	class FimpCache {
+	public:
+		static const Int max_entries = 4;
+		static const Int max_nargs = 4;
+
+		struct Key {
+			array<const AType *, max_nargs> types;
+
+			Key(): types{} { }
+			Key(const Box *begin, const Box *end);
+			bool operator ==(const Key &rhs) const { return types == rhs.types; }
+		};
+
+		struct KeyHash {
+			size_t operator ()(const Key &key) const;
+		};
+
+		struct Stats {
+			Int hits, misses, megamorphic;
+			Stats(): hits(0), misses(0), megamorphic(0) { }
+		};
+
+		FimpCache();
+
+		const FimpPtr *get(const Func &func,
+											 const Box *begin,
+											 const Box *end,
+											 Stats &stats);
+	private:
+		array<Key, max_entries> _keys;
+		array<FimpPtr, max_entries> _fimps;
+		Int _nentries, _version;
+		bool _megamorphic;
+	};
+}
+
+#endif
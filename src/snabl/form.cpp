@@ -5,13 +5,6 @@
 namespace snabl {
 	AFormType::AFormType(string_view id): id(id) { }
 
-	FormImp::~FormImp() { }
-
-	Form::Form(const Form &source):
-		type(source.type),
-		pos(source.pos),
-		imp(source.imp->clone()) { }
-
 	namespace forms {
 		const FormType<Comma> Comma::type("comma");
 		const FormType<Fimp> Fimp::type("fimp");
@@ -23,8 +16,6 @@ namespace snabl {
 		const FormType<Sexpr> Sexpr::type("sexpr");
 		const FormType<Stack> Stack::type("stack");
 
-		FormImp *Comma::clone() const { return new Comma(body.begin(), body.end()); }
-
 		void Comma::dump(ostream &out) const {
 			out << ", ";
 			char sep(0);
@@ -43,17 +34,11 @@ namespace snabl {
 			env.compile(sexpr.body);
 		}
 
-		Fimp::Fimp(Sym id,
-							 Forms::const_iterator begin,
-							 Forms::const_iterator end): id(id) {
-			transform(begin, end, back_inserter(type_ids),
+		Fimp::Fimp(Sym id, const Forms &body): id(id) {
+			transform(body.begin(), body.end(), back_inserter(type_ids),
 								[](const Form &f) -> Sym { return f.as<Id>().id; });
 		}
 
-		Fimp::Fimp(Sym id, const Ids &type_ids): id(id), type_ids(type_ids) { }
-
-		FormImp *Fimp::clone() const { return new Fimp(id, type_ids); }
-
 		void Fimp::dump(ostream &out) const {
 			out << id << '<';
 			char sep(0);
@@ -73,7 +58,8 @@ namespace snabl {
 			auto &lib(env.lib());
 			auto pos(in->pos);
 			auto &form((in++)->as<Fimp>());
-			env.compile(Form(Id::type, pos, form.id), func, fimp);
+			const Id id(form.id);
+			env.compile(Form(Id::type, pos, id), func, fimp);
 			if (!func) { throw CompileError(pos, "Missing func"); }
 			snabl::Stack args;
 				
@@ -93,15 +79,13 @@ namespace snabl {
 				throw CompileError(pos, fmt("Wrong number of args: %0", {func->id}));
 			}
 			
-			auto fi(func->get_best_fimp(args.begin(), args.end()));
+			auto fi(func->get_best_fimp(args.data(), args.data()+args.size()));
 			if (!fi) { throw CompileError(pos, fmt("Unknown fimp: %0", {func->id})); }
 			fimp = *fi;
 		}
 
 		Id::Id(Sym id): id(id) { }
 
-		FormImp *Id::clone() const { return new Id(id); }
-
 		void Id::dump(ostream &out) const { out << id.name(); }
 		
 		void Id::compile(Forms::const_iterator &in,
@@ -113,37 +97,36 @@ namespace snabl {
 
 			if (id.name().front() == '@') {
 				in++;
-				env.emit(ops::Get::type, form.pos, env.sym(id.name().substr(1)));
+				const auto var_id(env.sym(string_view(id.name()).substr(1)));
+				const auto var(env.get_var(var_id));
+				if (!var) { throw CompileError(form.pos, fmt("Unknown var: %0", {var_id})); }
+				env.emit(ops::GetSlot::type, form.pos, var_id, var->first, var->second);
 			} else if (isupper(id.name().front())) {
 				in++;
 				auto t(env.lib().get_type(id));
 				if (!t) { throw CompileError(form.pos, fmt("Unknown type: %0", {id})); }
 				env.emit(ops::Push::type, form.pos, env.meta_type, *t);
 			} else {
-				auto &lib(env.lib());
-				auto m(lib.get_macro(id));
+				const auto d(env.lib().get_defs(id));
 				
-				if (m) {
-					(*m)->call(in, end, func, fimp, env);
+				if (d && d->macro) {
+					(*d->macro)->call(in, end, func, fimp, env);
 				} else {
 					in++;
-					auto fn(lib.get_func(id));
 
-					if (!fn) {
+					if (!d || !d->func) {
 						throw CompileError(form.pos, fmt("Unknown id: '%0'", {id.name()}));
 					}
 					
 					if (func) {
-						throw CompileError(form.pos,fmt("Extra func: %0", {(*fn)->id}));
+						throw CompileError(form.pos,fmt("Extra func: %0", {(*d->func)->id}));
 					}
 						
-					func = *fn;
+					func = *d->func;
 				}
 			}
 		}
 
-		FormImp *Lambda::clone() const { return new Lambda(body.begin(), body.end()); }
-
 		void Lambda::dump(ostream &out) const {
 			out << '{';
 			char sep(0);
@@ -166,31 +149,22 @@ namespace snabl {
 			auto &start_op(env.emit(ops::Lambda::type, f.pos));
 			auto &start(start_op.as<ops::Lambda>());
 			env.begin_regs();
+			env.begin_vars();
+			env.begin_opts();
 			const auto offs(env.ops().size());
 			env.compile(l.body);
 			if (env.end_regs()) { start.opts |= Target::Opts::Regs; }
-			
-			for (auto bop(env.ops().begin()+offs);
-					 bop != env.ops().end();
-					 bop++) {
-				if (&bop->type == &ops::Get::type || &bop->type == &ops::Let::type) {
-					start.opts |= Target::Opts::Vars;
-				}
-				
-				if (&bop->type == &ops::Recall::type) {
-					start.opts |= Target::Opts::Recalls;
-				}
-			}
+			start.nvars = env.end_vars();
+			start.opts |= env.end_opts();
 			
 			env.emit(ops::Return::type, f.pos);
 			start.start_pc = start_op.next;
 			start.end_pc = env.ops().size();
+			env.tail_calls(offs, start.end_pc);
 		}
 		
 		Lit::Lit(const Box &val): val(val) { }
 
-		FormImp *Lit::clone() const { return new Lit(val); }
-
 		void Lit::dump(ostream &out) const { val.dump(out); }
 
 		void Lit::compile(Forms::const_iterator &in,
@@ -203,10 +177,6 @@ namespace snabl {
 
 		Query::Query(const Form &form): form(form) {}
 		
-		FormImp *Query::clone() const {
-			return new Query(form);
-		}
-
 		void Query::dump(ostream &out) const {
 			form.imp->dump(out);
 			out << '?';
@@ -237,8 +207,6 @@ namespace snabl {
 			in++;
 		}
 
-		FormImp *Semi::clone() const { return new Semi(body.begin(), body.end()); }
-
 		void Semi::dump(ostream &out) const {
 			out << "; ";
 			char sep(0);
@@ -259,8 +227,6 @@ namespace snabl {
 			env.compile(form.as<Semi>().body);
 		}
 
-		FormImp *Sexpr::clone() const { return new Sexpr(body.begin(), body.end()); }
-
 		void Sexpr::dump(ostream &out) const {
 			out << '(';
 			char sep(0);
@@ -282,15 +248,13 @@ namespace snabl {
 
 			bool split(!b.empty() &&
 								 &b.front().type == &forms::Id::type &&
-								 b.front().as<forms::Id>().id == env.sym("|"));
+								 b.front().as<forms::Id>().id == env.pipe_sym);
 
 			if (split) { env.emit(ops::Split::type, f.pos); }
 			env.compile(split ? b.begin()+1 : b.begin(), b.end());
 			if (split) { env.emit(ops::SplitEnd::type, f.pos); }
 		}
 		
-		FormImp *Stack::clone() const { return new Stack(body.begin(), body.end()); }
-
 		void Stack::dump(ostream &out) const {
 			out << '[';
 			char sep(0);
@@ -312,7 +276,7 @@ namespace snabl {
 
 			bool split(b.empty() ||
 								 &b.front().type != &forms::Id::type ||
-								 b.front().as<forms::Id>().id != env.sym(".."));
+								 b.front().as<forms::Id>().id != env.dots_sym);
 			
 			if (split) { env.emit(ops::Split::type, f.pos); }
 			env.compile(split ? b.begin() : b.begin()+1, b.end());
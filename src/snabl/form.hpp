@@ -10,9 +10,7 @@
 
 namespace snabl {
 	class Env;
-	class Form;
-
-	using Forms = deque<Form>;
+	struct FormImp;
 
 	struct AFormType {
 		const string id;
@@ -27,57 +25,70 @@ namespace snabl {
 
 	template <typename ImpT>
 	FormType<ImpT>::FormType(string_view id): AFormType(id) { }
-	
-	struct FormImp {
-		virtual ~FormImp();
-		virtual FormImp *clone() const=0;
-		virtual void dump(ostream &out) const=0;
 
-		virtual void compile(Forms::const_iterator &in,
-												 Forms::const_iterator end,
-												 FuncPtr &func, FimpPtr &fimp,
-												 Env &env) const=0;
-	};
+	/* Forms are immutable handles to imps that live in the Arena of the parse,
+		 copying one shares its imp. */
 	
 	class Form {
 	public:
 		const AFormType &type;
 		const Pos pos;
-		const unique_ptr<FormImp> imp;
+		const FormImp *const imp;
 		
-		template <typename ImpT, typename... ArgsT>
-		Form(const FormType<ImpT> &type, Pos pos, ArgsT &&... args);
-
-		Form(const Form &source);
+		template <typename ImpT>
+		Form(const FormType<ImpT> &type, Pos pos, const ImpT &imp):
+			type(type), pos(pos), imp(&imp) { }
 		
-		virtual ~Form() { }
 		template <typename ImpT>
-		ImpT &as() const;
+		const ImpT &as() const;
+	};
+
+	class Forms {
+	public:
+		using const_iterator = const Form *;
+		using const_reverse_iterator = reverse_iterator<const_iterator>;
+		
+		Forms(): _begin(nullptr), _end(nullptr) { }
+		Forms(const_iterator begin, const_iterator end): _begin(begin), _end(end) { }
+
+		const_iterator begin() const { return _begin; }
+		const_iterator end() const { return _end; }
+		const_reverse_iterator rbegin() const { return const_reverse_iterator(_end); }
+		const_reverse_iterator rend() const { return const_reverse_iterator(_begin); }
+		bool empty() const { return _begin == _end; }
+		Int size() const { return _end-_begin; }
+		const Form &front() const { return *_begin; }
+		const Form &back() const { return *(_end-1); }
+	private:
+		const_iterator _begin, _end;
 	};
 	
-	template <typename ImpT, typename... ArgsT>
-	Form::Form(const FormType<ImpT> &type, Pos pos, ArgsT &&... args):
-		type(type), pos(pos), imp(new ImpT(forward<ArgsT>(args)...)) { }
+	struct FormImp {
+		virtual void dump(ostream &out) const=0;
 
+		virtual void compile(Forms::const_iterator &in,
+												 Forms::const_iterator end,
+												 FuncPtr &func, FimpPtr &fimp,
+												 Env &env) const=0;
+	protected:
+		~FormImp() = default;
+	};
+	
 	template <typename ImpT>
-	ImpT &Form::as() const {
-		return *dynamic_cast<ImpT *>(imp.get());
+	const ImpT &Form::as() const {
+		return *dynamic_cast<const ImpT *>(imp);
 	}
 
 	namespace forms {
 		struct Body: public FormImp {			
 			const Forms body;
-			Body(Forms::const_iterator begin, Forms::const_iterator end):
-				body(begin, end) { }
+			Body(const Forms &body): body(body) { }
 		};
 
 		struct Comma: public Body {			
 			static const FormType<Comma> type;
 
-			Comma(Forms::const_iterator begin, Forms::const_iterator end):
-				Body(begin, end) { }
-			
-			FormImp *clone() const override;
+			Comma(const Forms &body): Body(body) { }
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -93,9 +104,7 @@ namespace snabl {
 			const Sym id;
 			Ids type_ids;
 			
-			Fimp(Sym id, Forms::const_iterator begin, Forms::const_iterator end);
-			Fimp(Sym id, const Ids &type_ids);
-			FormImp *clone() const override;
+			Fimp(Sym id, const Forms &body);
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -109,7 +118,6 @@ namespace snabl {
 			const Sym id;
 			
 			Id(Sym id);
-			FormImp *clone() const override;
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -121,10 +129,7 @@ namespace snabl {
 		struct Lambda: public Body {			
 			static const FormType<Lambda> type;
 
-			Lambda(Forms::const_iterator begin, Forms::const_iterator end):
-				Body(begin, end) { }
-			
-			FormImp *clone() const override;
+			Lambda(const Forms &body): Body(body) { }
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -138,7 +143,6 @@ namespace snabl {
 			const Box val;
 
 			Lit(const Box &val);
-			FormImp *clone() const override;
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -152,7 +156,6 @@ namespace snabl {
 			const Form form;
 			
 			Query(const Form &form);
-			FormImp *clone() const override;
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -164,10 +167,7 @@ namespace snabl {
 		struct Semi: public Body {			
 			static const FormType<Semi> type;
 
-			Semi(Forms::const_iterator begin, Forms::const_iterator end):
-				Body(begin, end) { }
-			
-			FormImp *clone() const override;
+			Semi(const Forms &body): Body(body) { }
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -179,10 +179,7 @@ namespace snabl {
 		struct Sexpr: public Body {			
 			static const FormType<Sexpr> type;
 
-			Sexpr(Forms::const_iterator begin, Forms::const_iterator end):
-				Body(begin, end) { }
-			
-			FormImp *clone() const override;
+			Sexpr(const Forms &body): Body(body) { }
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -194,10 +191,7 @@ namespace snabl {
 		struct Stack: public Body {			
 			static const FormType<Stack> type;
 
-			Stack(Forms::const_iterator begin, Forms::const_iterator end):
-				Body(begin, end) { }
-			
-			FormImp *clone() const override;
+			Stack(const Forms &body): Body(body) { }
 			void dump(ostream &out) const override;
 
 			void compile(Forms::const_iterator &in,
@@ -3,6 +3,7 @@
 
 #include "snabl/def.hpp"
 #include "snabl/fimp.hpp"
+#include "snabl/fimp_cache.hpp"
 #include "snabl/ptrs.hpp"
 #include "snabl/stack.hpp"
 #include "snabl/std.hpp"
@@ -20,35 +21,68 @@ namespace snabl {
 																	 const Fimp::Args &args,
 																	 ImpT &&... imp);
 		
-		Func(Lib &lib, Sym id, Int nargs): Def(id), lib(lib), nargs(nargs) { }
+		Func(Lib &lib, Sym id, Int nargs):
+			Def(id), lib(lib), nargs(nargs), _version(0), _has_vals(false) { }
 
 		const FimpPtr &get_fimp() const { return _fimps.begin()->second; }
+		const unordered_map<Sym, FimpPtr> &fimps() const { return _fimps; }
 
-		const FimpPtr *get_best_fimp(Stack::const_iterator begin,
-																 Stack::const_iterator end) const {
+		const FimpPtr *get_fimp(Sym id) const {
+			auto found(_fimps.find(id));
+			return (found == _fimps.end()) ? nullptr : &found->second;
+		}
+
+		const FimpPtr *get_best_fimp(const Box *begin, const Box *end) const {
+			return is_cacheable()
+				? get_best_fimp(FimpCache::Key(begin, end), begin, end)
+				: find_best_fimp(begin, end);
+		}
+
+		const FimpPtr *get_best_fimp(const FimpCache::Key &key,
+																 const Box *begin,
+																 const Box *end) const {
+			auto found(_dispatch.find(key));
+			if (found != _dispatch.end()) { return &found->second; }
+			auto fimp(find_best_fimp(begin, end));
+			return fimp ? &_dispatch.emplace(key, *fimp).first->second : nullptr;
+		}
+
+		const Int &version() const { return _version; }
+
+		bool is_cacheable() const {
+			return !_has_vals && nargs <= FimpCache::max_nargs;
+		}
+		
+		void clear() {
+			_fimps.clear();
+			_dispatch.clear();
+			_version++;
+		}
+	private:
+		unordered_map<Sym, FimpPtr> _fimps;
+		mutable unordered_map<FimpCache::Key, FimpPtr, FimpCache::KeyHash> _dispatch;
+		Int _version;
+		bool _has_vals;
+
+		const FimpPtr *find_best_fimp(const Box *begin, const Box *end) const {
 			Int best_score(-1);
-			FimpPtr *best_fimp(nullptr);
+			const FimpPtr *best_fimp(nullptr);
 			
 			for (auto &fp: _fimps) {
-				auto &f(const_cast<FimpPtr &>(fp.second));
+				auto &f(fp.second);
 				auto fs(f->score(begin, end));
 				
-				if (fs != -1) {
-					if (fs == 0) { return &f; }
-					
-					if (best_score == -1 || fs < best_score) {
-						best_score = fs;
-						best_fimp = &f;
-					}
+				if (fs != -1 &&
+						(best_score == -1 ||
+						 fs < best_score ||
+						 (fs == best_score && f->id.name() < (*best_fimp)->id.name()))) {
+					best_score = fs;
+					best_fimp = &f;
 				}
 			}
 			
 			return best_fimp;
 		}
-
-		void clear() { _fimps.clear(); }
-	private:
-		unordered_map<Sym, FimpPtr> _fimps;
 	};
 
 	template <typename... ImpT>
@@ -58,6 +92,12 @@ namespace snabl {
 		auto id(Fimp::get_id(*func, args));
 		auto found = func->_fimps.find(id);
 		if (found != func->_fimps.end()) { func->_fimps.erase(found); }
+		func->_dispatch.clear();
+		func->_version++;
+
+		for (auto &a: args) {
+			if (a.has_val()) { func->_has_vals = true; }
+		}
 
 		return func->_fimps.emplace(id,
 																make_shared<Fimp>(func, args, forward<ImpT>(imp)...))
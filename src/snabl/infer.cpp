@@ -0,0 +1,352 @@
+#include "snabl/env.hpp"
+#include "snabl/fimp.hpp"
+
+namespace snabl {
+	using InferStack = vector<const AType *>;
+
+	static void infer_pop(InferStack &s, Int n) {
+		if (Int(s.size()) < n) {
+			s.clear();
+		} else {
+			s.resize(s.size()-n);
+		}
+	}
+
+	static void infer_reserve(InferStack &s, Int n) {
+		if (Int(s.size()) < n) { s.insert(s.begin(), n-s.size(), nullptr); }
+	}
+
+	static bool infer_top(const InferStack &s, const AType *type, Int n) {
+		if (Int(s.size()) < n) { return false; }
+
+		for (auto i(s.end()-n); i != s.end(); i++) {
+			if (*i != type) { return false; }
+		}
+
+		return true;
+	}
+
+	static pair<OpCode, Int> unchecked_op(OpCode code) {
+		switch (code) {
+		case OpCode::Case:
+			return {OpCode::CaseUnchecked, 1};
+		case OpCode::CaseDrop:
+			return {OpCode::CaseDropUnchecked, 1};
+		case OpCode::DDrop:
+			return {OpCode::DDropUnchecked, 2};
+		case OpCode::Drop:
+			return {OpCode::DropUnchecked, 1};
+		case OpCode::Dup:
+			return {OpCode::DupUnchecked, 1};
+		case OpCode::Else:
+			return {OpCode::ElseUnchecked, 1};
+		case OpCode::Isa:
+			return {OpCode::IsaUnchecked, 1};
+		case OpCode::LetSlot:
+			return {OpCode::LetSlotUnchecked, 1};
+		case OpCode::Rot:
+			return {OpCode::RotUnchecked, 3};
+		case OpCode::RSwap:
+			return {OpCode::RSwapUnchecked, 3};
+		case OpCode::SDrop:
+			return {OpCode::SDropUnchecked, 2};
+		case OpCode::Swap:
+			return {OpCode::SwapUnchecked, 2};
+		case OpCode::Times:
+			return {OpCode::TimesUnchecked, 1};
+		default:
+			return {code, -1};
+		}
+	}
+	
+	void Env::infer(Int start_pc, Int end_pc, const InferStack &entry) {
+		vector<optional<InferStack>> in(end_pc-start_pc);
+		vector<Int> todo;
+		auto index([&](PC p) { return op_index(p, start_pc, end_pc); });
+
+		auto flow([&](Int pc, const InferStack &s) {
+				if (pc < start_pc || pc >= end_pc) { return; }
+				auto &prev(in[pc-start_pc]);
+
+				if (prev) {
+					auto &ps(*prev);
+					const auto n(min(ps.size(), s.size()));
+					InferStack js(n);
+
+					for (size_t i(0); i < n; i++) {
+						auto x(ps[ps.size()-n+i]), y(s[s.size()-n+i]);
+						js[i] = (x == y) ? x : nullptr;
+					}
+
+					if (js == ps) { return; }
+					ps.swap(js);
+				} else {
+					prev = s;
+				}
+
+				todo.push_back(pc);
+			});
+
+		flow(start_pc, entry);
+
+		while (!todo.empty()) {
+			const auto pc(todo.back());
+			todo.pop_back();
+			auto s(*in[pc-start_pc]);
+			auto &op(_ops[pc]);
+			const auto next(index(op.next));
+
+			switch (op.code) {
+			case OpCode::AddInt:
+			case OpCode::MulInt:
+			case OpCode::SubInt:
+				if (!infer_top(s, int_type.get(), 2)) { goto funcall; }
+				s.pop_back();
+				flow(next, s);
+				break;
+			case OpCode::AddIntLit:
+			case OpCode::MulIntLit:
+			case OpCode::SubIntLit:
+				if (!infer_top(s, int_type.get(), 1)) { goto funcall; }
+				flow(next, s);
+				break;
+			case OpCode::Call:
+				flow(next, {});
+				break;
+			case OpCode::Case:
+			case OpCode::CaseUnchecked:
+				infer_reserve(s, 1);
+				flow(next, s);
+				flow(op.as<ops::Case>().skip_pc, s);
+				break;
+			case OpCode::CaseDrop:
+			case OpCode::CaseDropUnchecked:
+				infer_reserve(s, 1);
+				flow(op.as<ops::Case>().skip_pc, s);
+				s.pop_back();
+				flow(next, s);
+				break;
+			case OpCode::DDrop:
+			case OpCode::DDropUnchecked:
+				infer_pop(s, 2);
+				flow(next, s);
+				break;
+			case OpCode::DecInt:
+			case OpCode::IncInt:
+				if (!infer_top(s, int_type.get(), 1)) { goto funcall; }
+				flow(next, s);
+				break;
+			case OpCode::Drop:
+			case OpCode::DropUnchecked:
+				infer_pop(s, 1);
+				flow(next, s);
+				break;
+			case OpCode::Dup:
+			case OpCode::DupUnchecked:
+				infer_reserve(s, 1);
+				s.push_back(s.back());
+				flow(next, s);
+				break;
+			case OpCode::Else:
+			case OpCode::ElseUnchecked:
+				infer_pop(s, 1);
+				flow(next, s);
+				flow(op.as<ops::Else>().skip_pc, s);
+				break;
+			case OpCode::Eqval:
+			case OpCode::Isa:
+			case OpCode::IsaUnchecked:
+				infer_reserve(s, 1);
+				s.back() = bool_type.get();
+				flow(next, s);
+				break;
+			case OpCode::Fimp:
+				flow(op.as<ops::Fimp>().ptr->_end_pc, s);
+				break;
+			case OpCode::Funcall:
+			case OpCode::TailCall:
+			funcall: {
+				const auto &o(op.as<ops::Funcall>());
+
+				if (o.fimp && !o.fimp->imp) {
+					infer_pop(s, o.func->nargs-(o.rhs ? 1 : 0));
+					flow(next, InferStack(s.size(), nullptr));
+				} else {
+					flow(next, {});
+				}
+
+				break;
+			}
+			case OpCode::GetSlot:
+				s.push_back(nullptr);
+				flow(next, s);
+				break;
+			case OpCode::Jump:
+				flow(op.as<ops::Jump>().end_pc, s);
+				break;
+			case OpCode::JumpIf:
+				flow(next, s);
+				flow(op.as<ops::JumpIf>().end_pc, s);
+				break;
+			case OpCode::Lambda:
+				flow(index(op.as<ops::Lambda>().start_pc), {});
+				s.push_back(lambda_type.get());
+				flow(op.as<ops::Lambda>().end_pc, s);
+				break;
+			case OpCode::LetSlot:
+			case OpCode::LetSlotUnchecked:
+			case OpCode::Times:
+			case OpCode::TimesUnchecked:
+				infer_pop(s, 1);
+				flow(next, s);
+				break;
+			case OpCode::LtInt:
+				if (!infer_top(s, int_type.get(), 2)) { goto funcall; }
+				s.pop_back();
+				s.back() = bool_type.get();
+				flow(next, s);
+				break;
+			case OpCode::LtIntLit:
+				if (!infer_top(s, int_type.get(), 1)) { goto funcall; }
+				s.back() = bool_type.get();
+				flow(next, s);
+				break;
+			case OpCode::Nop:
+			case OpCode::SplitEnd:
+			case OpCode::TryEnd:
+				flow(next, s);
+				break;
+			case OpCode::Push:
+				s.push_back(op.as<ops::Push>().val.type());
+				flow(next, s);
+				break;
+			case OpCode::Recall:
+				flow(start_pc, s);
+				break;
+			case OpCode::Return:
+			case OpCode::Throw:
+				break;
+			case OpCode::Rot:
+			case OpCode::RotUnchecked: {
+				infer_reserve(s, 3);
+				auto i(s.end()-1);
+				swap(*i, *(i-2));
+				swap(*i, *(i-1));
+				flow(next, s);
+				break;
+			}
+			case OpCode::RSwap:
+			case OpCode::RSwapUnchecked: {
+				infer_reserve(s, 3);
+				auto i(s.end()-1);
+				swap(*i, *(i-2));
+				flow(next, s);
+				break;
+			}
+			case OpCode::SDrop:
+			case OpCode::SDropUnchecked: {
+				infer_reserve(s, 2);
+				auto i(s.end()-1);
+				*(i-1) = *i;
+				s.pop_back();
+				flow(next, s);
+				break;
+			}
+			case OpCode::Split:
+				flow(next, {});
+				break;
+			case OpCode::Stack:
+				flow(next, {stack_type.get()});
+				break;
+			case OpCode::Swap:
+			case OpCode::SwapUnchecked: {
+				infer_reserve(s, 2);
+				auto i(s.end()-1);
+				swap(*i, *(i-1));
+				flow(next, s);
+				break;
+			}
+			case OpCode::Try:
+				flow(next, s);
+				flow(op.as<ops::Try>().handler_pc, {});
+				break;
+			}
+		}
+
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			auto &op(_ops[pc]);
+			const auto &s(in[pc-start_pc]);
+			if (!s) { continue; }
+			op.depth = s->size();
+			const auto u(unchecked_op(op.code));
+			if (u.second != -1 && op.depth >= u.second) { op.code = u.first; }
+		}
+		
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			auto &op(_ops[pc]);
+			const auto &s(in[pc-start_pc]);
+			if (!s) { continue; }
+
+			switch (op.code) {
+			case OpCode::AddInt:
+			case OpCode::LtInt:
+			case OpCode::MulInt:
+			case OpCode::SubInt:
+				if (infer_top(*s, int_type.get(), 2)) {
+					_infer_stats.calls++;
+					_infer_stats.resolved++;
+					continue;
+				}
+
+				break;
+			case OpCode::AddIntLit:
+			case OpCode::DecInt:
+			case OpCode::IncInt:
+			case OpCode::LtIntLit:
+			case OpCode::MulIntLit:
+			case OpCode::SubIntLit:
+				if (infer_top(*s, int_type.get(), 1)) {
+					_infer_stats.calls++;
+					_infer_stats.resolved++;
+					continue;
+				}
+
+				break;
+			case OpCode::Funcall:
+			case OpCode::TailCall:
+				break;
+			default:
+				continue;
+			}
+
+			_infer_stats.calls++;
+			auto &o(op.as<ops::Funcall>());
+			const auto &fn(*o.func);
+			InferStack cs(*s);
+			if (o.rhs) { cs.push_back(o.rhs->type()); }
+			if (Int(cs.size()) < fn.nargs) { continue; }
+			Stack args;
+
+			for (auto i(cs.end()-fn.nargs); i != cs.end(); i++) {
+				const auto t(*i ? (*i)->lib.get_type((*i)->id) : nullptr);
+				if (!t) { break; }
+				args.emplace_back(*t);
+			}
+
+			if (Int(args.size()) < fn.nargs) { continue; }
+			const FimpPtr *fimp(nullptr);
+
+			if (o.fimp) {
+				if (o.fimp->score(args.data(), args.data()+args.size()) != -1) { fimp = &o.fimp; }
+			} else if (fn.is_cacheable()) {
+				fimp = fn.get_best_fimp(args.data(), args.data()+args.size());
+			}
+
+			if (fimp) {
+				o.typed_fimp = *fimp;
+				o.typed_version = fn.version();
+				_infer_stats.resolved++;
+			}
+		}
+	}
+}
@@ -0,0 +1,448 @@
+#include <cstddef>
+#include <cstring>
+
+#include <sys/mman.h>
+
+#include "snabl/env.hpp"
+#include "snabl/jit.hpp"
+
+namespace snabl {
+	Jit::~Jit() {
+		for (auto &c: _code) { munmap(c.first, c.second); }
+	}
+
+	PC Jit::call(Fn fn, ValStack &stack) const { return fn(&stack._end, stack._max); }
+
+#if defined(__x86_64__)
+	enum Reg: uint8_t {RAX=0, RCX=1, RDX=2, R9=9, R10=10, R11=11};
+	enum Cond: uint8_t {CondE=0x4, CondNE=0x5};
+
+	/* Stack top lives in r8, rdi points to ValStack::_end and rsi holds _max;
+		 all ops address boxes relative to r8 and write through to memory. */
+
+	struct Asm {
+		vector<uint8_t> code;
+
+		Int size() const { return code.size(); }
+		void byte(uint8_t b) { code.push_back(b); }
+		void bytes(initializer_list<uint8_t> bs) { code.insert(code.end(), bs); }
+
+		template <typename T>
+		void imm(T val) {
+			uint8_t buf[sizeof(T)];
+			memcpy(buf, &val, sizeof(T));
+			code.insert(code.end(), buf, buf+sizeof(T));
+		}
+
+		void mem(initializer_list<uint8_t> opcode, uint8_t reg, Int disp, bool wide=true) {
+			byte(0x41 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0));
+			bytes(opcode);
+			byte(0x40 | ((reg & 7) << 3));
+			byte(static_cast<uint8_t>(static_cast<int8_t>(disp)));
+		}
+
+		void load(Reg reg, Int disp) { mem({0x8B}, reg, disp); }
+		void store(Int disp, Reg reg) { mem({0x89}, reg, disp); }
+
+		void movabs(Reg reg, uint64_t val) {
+			byte(0x48 | ((reg & 8) ? 0x01 : 0));
+			byte(0xB8 | (reg & 7));
+			imm(val);
+		}
+
+		void grow(Int n) {
+			bytes({0x49, 0x83, 0xC0});
+			byte(static_cast<uint8_t>(static_cast<int8_t>(n*Int(sizeof(Box)))));
+		}
+
+		Int jmp() {
+			byte(0xE9);
+			imm(int32_t(0));
+			return size()-4;
+		}
+
+		Int jcc(Cond cond) {
+			bytes({0x0F, uint8_t(0x80 | cond)});
+			imm(int32_t(0));
+			return size()-4;
+		}
+
+		void patch(Int pos, Int target) {
+			const int32_t rel(target-(pos+4));
+			memcpy(&code[pos], &rel, sizeof(rel));
+		}
+	};
+
+	class Jit::Emitter {
+	public:
+		Emitter(Env &env, const Target &target):
+			_env(env),
+			_target(target),
+			_int_bits(reinterpret_cast<uintptr_t>(env.int_type.get())),
+			_bool_bits(reinterpret_cast<uintptr_t>(env.bool_type.get())) { }
+
+		bool emit() {
+			const auto start(_target.start_pc());
+			if (!start || !is_supported(*start)) { return false; }
+			_asm.bytes({0x4C, 0x8B, 0x07});
+			vector<PC> todo{start};
+
+			while (!todo.empty()) {
+				auto p(todo.back());
+				todo.pop_back();
+
+				while (p && can_emit(*p)) {
+					_labels.emplace(p, _asm.size());
+					if (!emit_op(*p, todo)) { break; }
+					const auto next(p->next);
+
+					if (!next || !can_emit(*next)) {
+						jump(_asm.jmp(), next);
+						break;
+					}
+
+					p = next;
+				}
+			}
+
+			for (auto &f: _fixups) {
+				const auto found(f.exit ? _labels.end() : _labels.find(f.pc));
+				_asm.patch(f.pos, (found == _labels.end()) ? exit_stub(f.pc) : found->second);
+			}
+
+			return true;
+		}
+
+		const vector<uint8_t> &code() const { return _asm.code; }
+		Int nops() const { return _labels.size(); }
+	private:
+		struct Fixup {
+			Int pos;
+			const Op *pc;
+			bool exit;
+		};
+
+		Env &_env;
+		const Target &_target;
+		const uintptr_t _int_bits, _bool_bits;
+		Asm _asm;
+		unordered_map<const Op *, Int> _labels, _stubs;
+		vector<Fixup> _fixups;
+
+		static Int type_offs(Int i) { return -i*Int(sizeof(Box)); }
+		static Int val_offs(Int i) { return type_offs(i)+Int(offsetof(Box, _val)); }
+
+		bool can_emit(const Op &op) const {
+			return !_labels.count(&op) && Int(_labels.size()) < Jit::max_ops && is_supported(op);
+		}
+
+		bool is_supported(const Op &op) const {
+			switch (op.code) {
+			case OpCode::AddInt:
+			case OpCode::LtInt:
+			case OpCode::MulInt:
+			case OpCode::SubInt:
+			case OpCode::DDrop:
+			case OpCode::DDropUnchecked:
+			case OpCode::SDrop:
+			case OpCode::SDropUnchecked:
+			case OpCode::Swap:
+			case OpCode::SwapUnchecked:
+				return op.depth >= 2;
+			case OpCode::AddIntLit:
+			case OpCode::DecInt:
+			case OpCode::Drop:
+			case OpCode::DropUnchecked:
+			case OpCode::Dup:
+			case OpCode::DupUnchecked:
+			case OpCode::Else:
+			case OpCode::ElseUnchecked:
+			case OpCode::IncInt:
+			case OpCode::LtIntLit:
+			case OpCode::MulIntLit:
+			case OpCode::SubIntLit:
+				return op.depth >= 1;
+			case OpCode::Case:
+			case OpCode::CaseDrop:
+			case OpCode::CaseDropUnchecked:
+			case OpCode::CaseUnchecked:
+				return op.depth >= 1 && op.as<ops::Case>().rhs.type() == _env.int_type.get();
+			case OpCode::Jump:
+			case OpCode::Nop:
+				return true;
+			case OpCode::Push: {
+				const auto t(op.as<ops::Push>().val.type());
+				return t == _env.int_type.get() || t == _env.bool_type.get();
+			}
+			case OpCode::Recall:
+				return !(_target.opts() & Target::Opts::Vars);
+			case OpCode::Rot:
+			case OpCode::RotUnchecked:
+			case OpCode::RSwap:
+			case OpCode::RSwapUnchecked:
+				return op.depth >= 3;
+			default:
+				return false;
+			}
+		}
+
+		void jump(Int pos, const Op *pc) { _fixups.push_back({pos, pc, false}); }
+		void exit(Int pos, const Op &op) { _fixups.push_back({pos, &op, true}); }
+
+		Int exit_stub(const Op *pc) {
+			const auto found(_stubs.find(pc));
+			if (found != _stubs.end()) { return found->second; }
+			const auto pos(_asm.size());
+			_asm.bytes({0x4C, 0x89, 0x07});
+			_asm.movabs(RAX, reinterpret_cast<uintptr_t>(pc));
+			_asm.byte(0xC3);
+			_stubs.emplace(pc, pos);
+			return pos;
+		}
+
+		void guard_type(const Op &op, Int i, uintptr_t bits) {
+			_asm.movabs(RCX, bits);
+			_asm.mem({0x39}, RCX, type_offs(i));
+			exit(_asm.jcc(CondNE), op);
+		}
+
+		void guard_version(const Op &op) {
+			const auto &o(op.as<ops::Funcall>());
+			_asm.movabs(RAX, reinterpret_cast<uintptr_t>(&o.func->version()));
+			_asm.bytes({0x48, 0x8B, 0x00});
+			_asm.movabs(RCX, reinterpret_cast<uintptr_t>(&o.func_version));
+			_asm.bytes({0x48, 0x3B, 0x01});
+			exit(_asm.jcc(CondNE), op);
+		}
+
+		void guard_inline(const Op &op, Int i) {
+			_asm.mem({0xF6}, 0, type_offs(i), false);
+			_asm.byte(Box::Heap);
+			exit(_asm.jcc(CondNE), op);
+		}
+
+		void guard_room(const Op &op) {
+			_asm.bytes({0x49, 0x39, 0xF0});
+			exit(_asm.jcc(CondE), op);
+		}
+
+		void set_bool(Int i) {
+			_asm.bytes({0x0F, 0x9C, 0xC1, 0x0F, 0xB6, 0xC9});
+			_asm.store(val_offs(i), RCX);
+			_asm.movabs(RAX, _bool_bits);
+			_asm.store(type_offs(i), RAX);
+		}
+
+		void permute(initializer_list<Int> src) {
+			static const Reg regs[][2] = {{RAX, RCX}, {RDX, R9}, {R10, R11}};
+			const Int n(src.size());
+
+			for (Int i(0); i < n; i++) {
+				_asm.load(regs[i][0], type_offs(i+1));
+				_asm.load(regs[i][1], val_offs(i+1));
+			}
+
+			Int i(1);
+
+			for (auto s: src) {
+				_asm.store(type_offs(i), regs[s-1][0]);
+				_asm.store(val_offs(i), regs[s-1][1]);
+				i++;
+			}
+		}
+
+		bool emit_op(const Op &op, vector<PC> &todo) {
+			switch (op.code) {
+			case OpCode::AddInt:
+			case OpCode::MulInt:
+			case OpCode::SubInt:
+				guard_version(op);
+				guard_type(op, 1, _int_bits);
+				guard_type(op, 2, _int_bits);
+				_asm.load(RAX, val_offs(2));
+
+				switch (op.code) {
+				case OpCode::AddInt:
+					_asm.mem({0x03}, RAX, val_offs(1));
+					break;
+				case OpCode::MulInt:
+					_asm.mem({0x0F, 0xAF}, RAX, val_offs(1));
+					break;
+				default:
+					_asm.mem({0x2B}, RAX, val_offs(1));
+					break;
+				}
+
+				_asm.store(val_offs(2), RAX);
+				_asm.grow(-1);
+				return true;
+			case OpCode::AddIntLit:
+			case OpCode::MulIntLit:
+			case OpCode::SubIntLit:
+				guard_version(op);
+				guard_type(op, 1, _int_bits);
+				_asm.movabs(RCX, op.as<ops::Funcall>().rhs->as<Int>());
+
+				switch (op.code) {
+				case OpCode::AddIntLit:
+					_asm.mem({0x01}, RCX, val_offs(1));
+					break;
+				case OpCode::MulIntLit:
+					_asm.load(RAX, val_offs(1));
+					_asm.bytes({0x48, 0x0F, 0xAF, 0xC1});
+					_asm.store(val_offs(1), RAX);
+					break;
+				default:
+					_asm.mem({0x29}, RCX, val_offs(1));
+					break;
+				}
+
+				return true;
+			case OpCode::Case:
+			case OpCode::CaseDrop:
+			case OpCode::CaseDropUnchecked:
+			case OpCode::CaseUnchecked:
+				guard_type(op, 1, _int_bits);
+				_asm.movabs(RCX, op.as<ops::Case>().rhs.as<Int>());
+				_asm.mem({0x39}, RCX, val_offs(1));
+				jump(_asm.jcc(CondNE), op.branch);
+				todo.push_back(op.branch);
+
+				if (op.code == OpCode::CaseDrop || op.code == OpCode::CaseDropUnchecked) {
+					_asm.grow(-1);
+				}
+
+				return true;
+			case OpCode::DDrop:
+			case OpCode::DDropUnchecked:
+				guard_inline(op, 1);
+				guard_inline(op, 2);
+				_asm.grow(-2);
+				return true;
+			case OpCode::DecInt:
+			case OpCode::IncInt:
+				guard_version(op);
+				guard_type(op, 1, _int_bits);
+				_asm.mem({0xFF}, (op.code == OpCode::DecInt) ? 1 : 0, val_offs(1));
+				return true;
+			case OpCode::Drop:
+			case OpCode::DropUnchecked:
+				guard_inline(op, 1);
+				_asm.grow(-1);
+				return true;
+			case OpCode::Dup:
+			case OpCode::DupUnchecked:
+				guard_room(op);
+				guard_inline(op, 1);
+				_asm.load(RAX, type_offs(1));
+				_asm.load(RCX, val_offs(1));
+				_asm.store(type_offs(0), RAX);
+				_asm.store(val_offs(0), RCX);
+				_asm.grow(1);
+				return true;
+			case OpCode::Else:
+			case OpCode::ElseUnchecked:
+				guard_type(op, 1, _bool_bits);
+				_asm.grow(-1);
+				_asm.mem({0x80}, 7, val_offs(0), false);
+				_asm.byte(0);
+				jump(_asm.jcc(CondE), op.branch);
+				todo.push_back(op.branch);
+				return true;
+			case OpCode::Jump:
+				jump(_asm.jmp(), op.branch);
+				todo.push_back(op.branch);
+				return false;
+			case OpCode::LtInt:
+				guard_version(op);
+				guard_type(op, 1, _int_bits);
+				guard_type(op, 2, _int_bits);
+				_asm.load(RAX, val_offs(2));
+				_asm.mem({0x3B}, RAX, val_offs(1));
+				set_bool(2);
+				_asm.grow(-1);
+				return true;
+			case OpCode::LtIntLit:
+				guard_version(op);
+				guard_type(op, 1, _int_bits);
+				_asm.movabs(RCX, op.as<ops::Funcall>().rhs->as<Int>());
+				_asm.load(RAX, val_offs(1));
+				_asm.bytes({0x48, 0x39, 0xC8});
+				set_bool(1);
+				return true;
+			case OpCode::Nop:
+				return true;
+			case OpCode::Push: {
+				const auto &v(op.as<ops::Push>().val);
+				guard_room(op);
+				_asm.movabs(RAX, v._type);
+				_asm.store(type_offs(0), RAX);
+				uint64_t val(0);
+				memcpy(&val, v._val.data, sizeof(v._val.data));
+				_asm.movabs(RAX, val);
+				_asm.store(val_offs(0), RAX);
+				_asm.grow(1);
+				return true;
+			}
+			case OpCode::Recall:
+				jump(_asm.jmp(), _target.start_pc());
+				return false;
+			case OpCode::Rot:
+			case OpCode::RotUnchecked:
+				permute({2, 3, 1});
+				return true;
+			case OpCode::RSwap:
+			case OpCode::RSwapUnchecked:
+				permute({3, 2, 1});
+				return true;
+			case OpCode::SDrop:
+			case OpCode::SDropUnchecked:
+				guard_inline(op, 2);
+				_asm.load(RAX, type_offs(1));
+				_asm.load(RCX, val_offs(1));
+				_asm.store(type_offs(2), RAX);
+				_asm.store(val_offs(2), RCX);
+				_asm.grow(-1);
+				return true;
+			case OpCode::Swap:
+			case OpCode::SwapUnchecked:
+				permute({2, 1});
+				return true;
+			default:
+				throw Error(fmt("Jit op not supported: %0", {op.type.id}));
+			}
+		}
+	};
+
+	Jit::Fn Jit::compile(const Target &target) {
+		const auto start(target.start_pc());
+		const auto found(_fns.find(start));
+		if (found != _fns.end()) { return found->second; }
+		auto &fn(_fns[start]);
+		Emitter e(_env, target);
+		if (!e.emit()) { return fn; }
+
+		const auto &code(e.code());
+		const auto size(code.size());
+
+		auto p(mmap(nullptr, size, PROT_READ | PROT_WRITE,
+								MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+		if (p == MAP_FAILED) { return fn; }
+		memcpy(p, code.data(), size);
+
+		if (mprotect(p, size, PROT_READ | PROT_EXEC)) {
+			munmap(p, size);
+			return fn;
+		}
+
+		_code.emplace_back(p, size);
+		_stats.fns++;
+		_stats.ops += e.nops();
+		fn = reinterpret_cast<Fn>(p);
+		return fn;
+	}
+#else
+	Jit::Fn Jit::compile(const Target &target) { return nullptr; }
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef SNABL_JIT_HPP
+#define SNABL_JIT_HPP
+
+#include "snabl/ptrs.hpp"
+#include "snabl/std.hpp"
+#include "snabl/types.hpp"
+
+namespace snabl {
+	struct Box;
+	class Env;
+	class Target;
+	class ValStack;
+
+	class Jit {
+	public:
+		using Fn = PC (*)(Box **end, const Box *max);
+
+		struct Stats {
+			Int fns, ops;
+			Stats(): fns(0), ops(0) { }
+		};
+
+		static const Int max_ops = 1024;
+
+		Jit(Env &env): _env(env) { }
+		Jit(const Jit &)=delete;
+		const Jit &operator =(const Jit &)=delete;
+		~Jit();
+
+		Fn compile(const Target &target);
+		PC call(Fn fn, ValStack &stack) const;
+		const Stats &stats() const { return _stats; }
+	private:
+		class Emitter;
+
+		Env &_env;
+		unordered_map<PC, Fn> _fns;
+		vector<pair<void *, size_t>> _code;
+		Stats _stats;
+	};
+}
+
+#endif
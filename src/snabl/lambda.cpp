@@ -3,17 +3,17 @@
 
 namespace snabl {
 	void Lambda::call(const LambdaPtr &l, Env &env, Pos pos, bool now) {
-		if (l->_parent_scope) { env.begin_scope(l->_parent_scope); }
+		if (l->_parent_scope) { env.begin_scope(*l); }
 		
 		if (now) {
 			const auto prev_pc(env.pc());
-			env.begin_call(l, pos, nullptr);
-			env.jump(&l->_start_pc);
+			env.begin_call(*l, pos, nullptr);
+			env.enter(*l);
 			env.run();
 			env.jump(prev_pc);
 		} else {
-			env.begin_call(l, pos, env.pc());
-			env.jump(&l->_start_pc);
+			env.begin_call(*l, pos, env.pc(), false, l);
+			env.enter(*l);
 		}
 	}
 
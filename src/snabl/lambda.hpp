@@ -11,8 +11,9 @@ namespace snabl {
 		static void call(const LambdaPtr &l, Env &env, Pos pos, bool now);
 
 		Lambda(const ScopePtr &parent_scope,
-					 const OpImp &start_pc, Int end_pc,
-					 Opts opts): Target(parent_scope, start_pc, end_pc, opts) { }
+					 PC start_pc, Int end_pc,
+					 Opts opts, Int nvars):
+			Target(parent_scope, start_pc, end_pc, opts, nvars) { }
 
 		string target_id() const override { return fmt("Lambda(%0)", {this}); }		
 	private:
@@ -10,7 +10,9 @@ namespace snabl {
 	const MacroPtr &Lib::add_macro(Sym id, const Macro::Imp &imp) {
 		auto found(_macros.find(id));
 		if (found != _macros.end()) { _macros.erase(found); }
-		return _macros.emplace(id, make_shared<Macro>(*this, id, imp)).first->second;
+		auto &m(_macros.emplace(id, make_shared<Macro>(*this, id, imp)).first->second);
+		_defs[id].macro = &m;
+		return m;
 	}
 	
 	const FuncPtr &Lib::add_func(Sym id, Int nargs) {
@@ -22,7 +24,9 @@ namespace snabl {
 			return f;
 		}
 		
-		return _funcs.emplace(id, make_shared<Func>(*this, id, nargs)).first->second;
+		auto &f(_funcs.emplace(id, make_shared<Func>(*this, id, nargs)).first->second);
+		_defs[id].func = &f;
+		return f;
 	}
 
 	
@@ -14,6 +14,12 @@ namespace snabl {
 	
 	class Lib: public Def {
 	public:
+		struct Defs {
+			const MacroPtr *macro;
+			const FuncPtr *func;
+			Defs(): macro(nullptr), func(nullptr) { }
+		};
+		
 		Env &env;
 		
 		Lib(Env &env, Sym id);
@@ -40,10 +46,17 @@ namespace snabl {
 		const MacroPtr *get_macro(Sym id);
 		const ATypePtr *get_type(Sym id);
 		const FuncPtr *get_func(Sym id);
+		const unordered_map<Sym, FuncPtr> &funcs() const { return _funcs; }
+
+		const Defs *get_defs(Sym id) const {
+			const auto found(_defs.find(id));
+			return (found == _defs.end()) ? nullptr : &found->second;
+		}
 	private:
 		unordered_map<Sym, MacroPtr> _macros;
 		unordered_map<Sym, ATypePtr> _types;
 		unordered_map<Sym, FuncPtr> _funcs;
+		unordered_map<Sym, Defs> _defs;
 	};
 
 	template <typename TypeT, typename... ArgsT>
@@ -61,14 +61,12 @@ namespace snabl {
 									 FuncPtr &func, FimpPtr &fimp,
 									 Env &env) {
 									const auto form(*in++);
-									auto &op(env.emit(ops::Try::type, form.pos, env.begin_reg())
-													 .as<ops::Try>());
+									auto &op(env.emit(ops::Try::type, form.pos).as<ops::Try>());
 									if (in == end) { throw SyntaxError(form.pos, "Missing handler"); }
 									const auto &handler(*in++);
 									if (in == end) { throw SyntaxError(form.pos, "Missing body"); }
 									env.compile(*in++);
-									env.emit(ops::TryEnd::type, form.pos, op.state_reg);
-									env.end_reg(op.state_reg);
+									env.emit(ops::TryEnd::type, form.pos);
 									env.emit(ops::Push::type, form.pos, env.nil_type);
 									op.handler_pc = env.ops().size();
 									env.compile(handler);
@@ -83,12 +81,14 @@ namespace snabl {
 									auto &p(*in++);
 
 									if (&p.type == &forms::Id::type) {
-										env.emit(ops::Let::type, form.pos, p.as<forms::Id>().id);
+										const auto id(p.as<forms::Id>().id);
+										env.emit(ops::LetSlot::type, form.pos, id, env.let_var(id));
 									} else {
 										auto &b(p.as<forms::Body>().body);
 
 										for (auto pp = b.rbegin(); pp != b.rend(); pp++) {
-											env.emit(ops::Let::type, form.pos, pp->as<forms::Id>().id);
+											const auto id(pp->as<forms::Id>().id);
+											env.emit(ops::LetSlot::type, form.pos, id, env.let_var(id));
 										}
 									}
 								});
@@ -152,9 +152,8 @@ namespace snabl {
 									env.emit(ops::Times::type, form.pos, i_reg);
 									const auto start_pc(env.ops().size());
 
-									auto &jump(env.emit(ops::JumpIf::type, form.pos, [&env, i_reg]() {
-												return !env.get_reg<Int>(i_reg)--;
-											}).as<ops::JumpIf>());
+									auto &jump(env.emit(ops::JumpIf::type, form.pos, i_reg)
+														 .as<ops::JumpIf>());
 									
 									env.compile(*in++);
 									env.end_reg(i_reg);
@@ -216,14 +215,14 @@ namespace snabl {
 							 [&env](Fimp &fimp) {
 								 Box y(env.pop()), x(env.pop());
 								 env.push(env.bool_type, x.isa(y.as<ATypePtr>()));
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("="),
 							 {Box(env.maybe_type), Box(env.maybe_type)},
 							 [&env](Fimp &fimp) {
 								 Box y(env.pop()), x(env.pop());
 								 env.push(env.bool_type, x.eqval(y));
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("=="),
 							 {Box(env.maybe_type), Box(env.maybe_type)},
@@ -232,65 +231,72 @@ namespace snabl {
 								 env.push(env.bool_type, x.equid(y));
 							 });
 
-			add_fimp(env.sym("<"),
-							 {Box(env.root_type), Box(env.root_type)},
-							 [&env](Fimp &fimp) {
-								 Box y(env.pop()), x(env.pop());
-								 env.push(env.bool_type, x.cmp(y) == Cmp::LT);
-							 });
+			const auto lt([&env](Fimp &fimp) {
+					Box y(env.pop()), x(env.pop());
+					env.push(env.bool_type, x.cmp(y) == Cmp::LT);
+				});
+			
+			add_fimp(env.sym("<"), {Box(env.root_type), Box(env.root_type)}, lt);
+
+			// Only value-ordered types are safe to fold
+			
+			for (const ATypePtr &t: initializer_list<ATypePtr>{
+					env.char_type, env.float_type, env.int_type, env.str_type, env.time_type}) {
+				add_fimp(env.sym("<"), {Box(t), Box(t)}, lt)->pure = true;
+			}
 	
 			add_fimp(env.sym("int"),
 							 {Box(env.float_type)},
 							 [&env](Fimp &fimp) {
 								 const Float v(env.pop().as<Float>());
 								 env.push(env.int_type, Int(v));
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("float"),
 							 {Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 const Int v(env.pop().as<Int>());
 								 env.push(env.float_type, Float(v));
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("++"),
 							 {Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 env.peek().as<Int>()++;
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("--"),
 							 {Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 env.peek().as<Int>()--;
-							 });
+							 })->pure = true;
 			
 			add_fimp(env.sym("+"),
 							 {Box(env.int_type), Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 Int y(env.pop().as<Int>());
 								 env.peek().as<Int>() += y;
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("-"),
 							 {Box(env.int_type), Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 Int y(env.pop().as<Int>());
 								 env.peek().as<Int>() -= y;
-							 });
+							 })->pure = true;
 			
 			add_fimp(env.sym("*"),
 							 {Box(env.int_type), Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 Int y(env.pop().as<Int>());
 								 env.peek().as<Int>() *= y;
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("bool"),
 							 {Box(env.maybe_type)},
 							 [&env](Fimp &fimp) {
 								 env.push(env.bool_type, env.pop().as_bool());
-							 });
+							 })->pure = true;
 
 			add_fimp(env.sym("iter"),
 							 {Box(env.seq_type)},
@@ -339,19 +345,19 @@ namespace snabl {
 							 {Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 env.push(env.time_type, env.pop().as<Int>());
-							 });			
+							 })->pure = true;			
 
 			add_fimp(env.sym("ms"),
 							 {Box(env.int_type)},
 							 [&env](Fimp &fimp) {
 								 env.push(env.time_type, Time::ms(env.pop().as<Int>()));
-							 });			
+							 })->pure = true;			
 
 			add_fimp(env.sym("ms"),
 							 {Box(env.time_type)},
 							 [&env](Fimp &fimp) {
 								 env.push(env.int_type, env.pop().as<Time>().as_ms());
-							 });
+							 })->pure = true;
 			
 			add_fimp(env.sym("sleep"),
 							 {Box(env.time_type)},
@@ -397,7 +403,15 @@ namespace snabl {
 								 }
 
 								 v.as<Int>() = b;
-							 });
+							 })->pure = true;
+
+			env.add_int_op(*get_func(env.sym("+")), ops::AddInt::type);
+			env.add_int_op(*get_func(env.sym("--")), ops::DecInt::type);
+			env.add_int_op(*get_func(env.sym("++")), ops::IncInt::type);
+			env.add_int_op(*get_func(env.sym("<")), ops::LtInt::type);
+			env.add_int_op(*get_func(env.sym("*")), ops::MulInt::type);
+			env.add_int_op(*get_func(env.sym("-")), ops::SubInt::type);
+			env.add_func_op(*get_func(env.sym("throw")), ops::Throw::type);
 		}
 	}
 }
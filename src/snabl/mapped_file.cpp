@@ -0,0 +1,40 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snabl/error.hpp"
+#include "snabl/fmt.hpp"
+#include "snabl/mapped_file.hpp"
+
+namespace snabl {
+	MappedFile::MappedFile(const string &path): _data(nullptr), _size(0) {
+		const auto fd(open(path.c_str(), O_RDONLY));
+		if (fd == -1) { throw Error(fmt("File not found: %0", {path})); }
+		struct stat s;
+
+		if (fstat(fd, &s) == -1) {
+			close(fd);
+			throw Error(fmt("Failed reading file: %0", {path}));
+		}
+
+		_size = s.st_size;
+		
+		if (_size) {
+			_data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			
+			if (_data == MAP_FAILED) {
+				close(fd);
+				throw Error(fmt("Failed mapping file: %0", {path}));
+			}
+
+			madvise(_data, _size, MADV_SEQUENTIAL);
+		}
+		
+		close(fd);
+	}
+
+	MappedFile::~MappedFile() {
+		if (_data) { munmap(_data, _size); }
+	}
+}
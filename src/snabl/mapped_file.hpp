@@ -0,0 +1,23 @@
+#ifndef SNABL_MAPPED_FILE_HPP
+#define SNABL_MAPPED_FILE_HPP
+
+#include "snabl/std.hpp"
+
+namespace snabl {
+	class MappedFile {
+	public:
+		MappedFile(const string &path);
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		const MappedFile &operator=(const MappedFile &) = delete;
+		
+		string_view view() const {
+			return string_view(static_cast<const char *>(_data), _size);
+		}
+	private:
+		void *_data;
+		size_t _size;
+	};
+}
+
+#endif
@@ -2,9 +2,11 @@
 #define SNABL_OP_HPP
 
 #include "snabl/box.hpp"
+#include "snabl/fimp_cache.hpp"
 #include "snabl/pos.hpp"
 #include "snabl/ptrs.hpp"
 #include "snabl/scope.hpp"
+#include "snabl/segarray.hpp"
 #include "snabl/state.hpp"
 #include "snabl/std.hpp"
 #include "snabl/sym.hpp"
@@ -13,75 +15,66 @@
 
 namespace snabl {
 	struct Op;
-	
-	using Ops = deque<Op>;
+
+	static const Int OpsSegSize = 256;
+	using Ops = Segarray<Op, OpsSegSize>;
+
+	enum class OpCode {
+		AddInt, AddIntLit, Call, Case, CaseDrop, CaseDropUnchecked, CaseUnchecked,
+		DDrop, DDropUnchecked, DecInt, Drop, DropUnchecked, Dup, DupUnchecked, Else,
+		ElseUnchecked, Eqval, Fimp, Funcall, GetSlot, IncInt, Isa, IsaUnchecked, Jump,
+		JumpIf, Lambda, LetSlot, LetSlotUnchecked, LtInt, LtIntLit,
+		MulInt, MulIntLit, Nop, Push, Recall, Return, Rot, RotUnchecked, RSwap,
+		RSwapUnchecked, SDrop, SDropUnchecked, Split, SplitEnd, Stack, SubInt,
+		SubIntLit, Swap, SwapUnchecked, TailCall, Throw, Times, TimesUnchecked, Try,
+		TryEnd
+	};
 	
 	struct AOpType {
 		const string id;
-		AOpType(const string &id): id(id) { }
+		const OpCode code;
+		AOpType(const string &id, OpCode code): id(id), code(code) { }
 		AOpType(const AOpType &) = delete;
 		const AOpType &operator=(const AOpType &) = delete;
-		virtual OpImp make_imp(Env &env, Op &op) const=0;
 		virtual void dump(const Op &op, ostream &out) const { }
 	};
 
 	template <typename DataT>
 	struct OpType: public AOpType {
-		OpType(const string &id): AOpType(id) { }		
+		OpType(const string &id, OpCode code): AOpType(id, code) { }		
 		void dump(const Op &op, ostream &out) const override;
 		virtual void dump_data(const DataT &op, ostream &out) const { }
 	};
-		
-	struct Op {
-	private:		
-		any _data;
-	public:
-		const AOpType &type;
-		const Pos pos;
-		const OpImp imp;
-		OpImp next;
-
-		Op(const Op &src)=delete;
-		
-		template <typename DataT, typename... ArgsT>
-		Op(Env &env, const OpType<DataT> &type, Pos pos, ArgsT &&... args):
-			_data(DataT(forward<ArgsT>(args)...)),
-			type(type),
-			pos(pos),
-			imp(type.make_imp(env, *this)) { }
-
-		template <typename DataT>
-		const DataT &as() const { return any_cast<const DataT &>(_data); }
-
-		template <typename DataT>
-		DataT &as() { return any_cast<DataT &>(_data); }
-
-		void dump(ostream &out) const {
-			out << type.id;
-			type.dump(*this, out);
-			out << endl;
-		}
-	};
-	
-	template <typename DataT>
-	void OpType<DataT>::dump(const Op &op, ostream &out) const {
-		dump_data(op.as<DataT>(), out);
-	}
 
 	namespace ops {
 		struct Call {				
 			struct Type: public OpType<Call> {
-				Type(const string &id): OpType<Call>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Call>(id, OpCode::Call) { }
 			};
 
 			static const Type type;
 		};
 
+		struct Case {
+			struct Type: public OpType<Case> {
+				Type(const string &id, OpCode code=OpCode::Case):
+					OpType<Case>(id, code) { }
+				
+				void dump_data(const Case &op, ostream &out) const override;
+			};
+
+			static const Type type;
+			const Box rhs;
+			Int skip_pc;
+			
+			Case(const Box &rhs, Int skip_pc): rhs(rhs), skip_pc(skip_pc) { }
+		};
+
+		struct CaseDrop { static const Case::Type type; };
+
 		struct DDrop {
 			struct Type: public OpType<DDrop> {
-				Type(const string &id): OpType<DDrop>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<DDrop>(id, OpCode::DDrop) { }
 			};
 
 			static const Type type;
@@ -89,8 +82,7 @@ namespace snabl {
 
 		struct Drop {
 			struct Type: public OpType<Drop> {
-				Type(const string &id): OpType<Drop>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Drop>(id, OpCode::Drop) { }
 			};
 
 			static const Type type;
@@ -98,8 +90,7 @@ namespace snabl {
 
 		struct Dup {
 			struct Type: public OpType<Dup> {
-				Type(const string &id): OpType<Dup>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Dup>(id, OpCode::Dup) { }
 			};
 
 			static const Type type;
@@ -107,8 +98,7 @@ namespace snabl {
 
 		struct Else {
 			struct Type: public OpType<Else> {
-				Type(const string &id): OpType<Else>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Else>(id, OpCode::Else) { }
 			};
 
 			static const Type type;
@@ -119,9 +109,8 @@ namespace snabl {
 		
 		struct Eqval {
 			struct Type: public OpType<Eqval> {
-				Type(const string &id): OpType<Eqval>(id) { }
+				Type(const string &id): OpType<Eqval>(id, OpCode::Eqval) { }
 				void dump_data(const Eqval &op, ostream &out) const override;
-				OpImp make_imp(Env &env, Op &op) const override;
 			};
 
 			static const Type type;
@@ -131,9 +120,8 @@ namespace snabl {
 
 		struct Fimp {
 			struct Type: public OpType<Fimp> {
-				Type(const string &id): OpType<Fimp>(id) { }
+				Type(const string &id): OpType<Fimp>(id, OpCode::Fimp) { }
 				void dump_data(const Fimp &op, ostream &out) const override;
-				OpImp make_imp(Env &env, Op &op) const override;
 			};
 
 			static const Type type;
@@ -144,36 +132,55 @@ namespace snabl {
 
 		struct Funcall {
 			struct Type: public OpType<Funcall> {
-				Type(const string &id): OpType<Funcall>(id) { }
+				Type(const string &id, OpCode code=OpCode::Funcall):
+					OpType<Funcall>(id, code) { }
+				
 				void dump_data(const Funcall &op, ostream &out) const override;
-				OpImp make_imp(Env &env, Op &op) const override;
 			};
 			
 			static const Type type;
 			const FuncPtr func;
 			const FimpPtr fimp;
+			const optional<const Box> rhs;
+			
+			FimpCache *cache;
+			FimpPtr typed_fimp;
+			Int typed_version, func_version;
 			
-			FimpPtr prev_fimp;
 			Funcall(const FuncPtr &func);
 			Funcall(const FimpPtr &fimp);
+			Funcall(const FuncPtr &func, const Box &rhs);
 		};
+
+		struct AddInt { static const Funcall::Type type; };
+		struct AddIntLit { static const Funcall::Type type; };
+		struct DecInt { static const Funcall::Type type; };
+		struct IncInt { static const Funcall::Type type; };
+		struct LtInt { static const Funcall::Type type; };
+		struct LtIntLit { static const Funcall::Type type; };
+		struct MulInt { static const Funcall::Type type; };
+		struct MulIntLit { static const Funcall::Type type; };
+		struct SubInt { static const Funcall::Type type; };
+		struct SubIntLit { static const Funcall::Type type; };
+		struct TailCall { static const Funcall::Type type; };
+		struct Throw { static const Funcall::Type type; };
 		
-		struct Get {
-			struct Type: public OpType<Get> {
-				Type(const string &id): OpType<Get>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+		struct GetSlot {
+			struct Type: public OpType<GetSlot> {
+				Type(const string &id): OpType<GetSlot>(id, OpCode::GetSlot) { }
+				void dump_data(const GetSlot &op, ostream &out) const override;
 			};
 
 			static const Type type;
 			const Sym id;
-			Get(Sym id): id(id) { }
+			const Int depth, slot;
+			GetSlot(Sym id, Int depth, Int slot): id(id), depth(depth), slot(slot) { }
 		};
 
 		struct Isa {
 			struct Type: public OpType<Isa> {
-				Type(const string &id): OpType<Isa>(id) { }
+				Type(const string &id): OpType<Isa>(id, OpCode::Isa) { }
 				void dump_data(const Isa &op, ostream &out) const override;
-				OpImp make_imp(Env &env, Op &op) const override;
 			};
 
 			static const Type type;
@@ -183,8 +190,7 @@ namespace snabl {
 
 		struct Jump {
 			struct Type: public OpType<Jump> {
-				Type(const string &id): OpType<Jump>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Jump>(id, OpCode::Jump) { }
 			};
 
 			static const Type type;
@@ -195,47 +201,47 @@ namespace snabl {
 
 		struct JumpIf {
 			struct Type: public OpType<JumpIf> {
-				Type(const string &id): OpType<JumpIf>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<JumpIf>(id, OpCode::JumpIf) { }
 			};
 
 			static const Type type;
-			function<bool ()> cond;
+			const Int i_reg;
 			Int end_pc;
 			
-			JumpIf(function<bool ()> &&cond): cond(move(cond)), end_pc(-1) { } 
+			JumpIf(Int i_reg): i_reg(i_reg), end_pc(-1) { } 
 		};
 
 
 		struct Lambda {
 			struct Type: public OpType<Lambda> {
-				Type(const string &id): OpType<Lambda>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Lambda>(id, OpCode::Lambda) { }
 			};
 
 			static const Type type;
-			OpImp start_pc;
+			PC start_pc;
 			Int end_pc;
 			Target::Opts opts;
+			Int nvars;
 			
-			Lambda(): end_pc(-1), opts(Target::Opts::None) { }
+			Lambda():
+				start_pc(nullptr), end_pc(-1), opts(Target::Opts::None), nvars(0) { }
 		};
 
-		struct Let {
-			struct Type: public OpType<Let> {
-				Type(const string &id): OpType<Let>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+		struct LetSlot {
+			struct Type: public OpType<LetSlot> {
+				Type(const string &id): OpType<LetSlot>(id, OpCode::LetSlot) { }
+				void dump_data(const LetSlot &op, ostream &out) const override;
 			};
 
 			static const Type type;
 			const Sym id;
-			Let(Sym id): id(id) { }
+			const Int slot;
+			LetSlot(Sym id, Int slot): id(id), slot(slot) { }
 		};
 
 		struct Nop {
 			struct Type: public OpType<Nop> {
-				Type(const string &id): OpType<Nop>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Nop>(id, OpCode::Nop) { }
 			};
 
 			static const Type type;
@@ -243,9 +249,8 @@ namespace snabl {
 
 		struct Push {
 			struct Type: public OpType<Push> {
-				Type(const string &id): OpType<Push>(id) { }
+				Type(const string &id): OpType<Push>(id, OpCode::Push) { }
 				void dump_data(const Push &op, ostream &out) const override;
-				OpImp make_imp(Env &env, Op &op) const override;
 			};
 				
 			static const Type type;			
@@ -258,8 +263,7 @@ namespace snabl {
 
 		struct Recall {
 			struct Type: public OpType<Recall> {
-				Type(const string &id): OpType<Recall>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Recall>(id, OpCode::Recall) { }
 			};
 
 			static const Type type;
@@ -267,8 +271,7 @@ namespace snabl {
 
 		struct Return {
 			struct Type: public OpType<Return> {
-				Type(const string &id): OpType<Return>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Return>(id, OpCode::Return) { }
 			};
 
 			static const Type type;
@@ -276,8 +279,7 @@ namespace snabl {
 
 		struct Rot {
 			struct Type: public OpType<Rot> {
-				Type(const string &id): OpType<Rot>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Rot>(id, OpCode::Rot) { }
 			};
 
 			static const Type type;
@@ -285,8 +287,7 @@ namespace snabl {
 
 		struct RSwap {
 			struct Type: public OpType<RSwap> {
-				Type(const string &id): OpType<RSwap>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<RSwap>(id, OpCode::RSwap) { }
 			};
 
 			static const Type type;
@@ -294,8 +295,7 @@ namespace snabl {
 
 		struct SDrop {
 			struct Type: public OpType<SDrop> {
-				Type(const string &id): OpType<SDrop>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<SDrop>(id, OpCode::SDrop) { }
 			};
 
 			static const Type type;
@@ -303,8 +303,7 @@ namespace snabl {
 
 		struct Split {
 			struct Type: public OpType<Split> {
-				Type(const string &id): OpType<Split>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Split>(id, OpCode::Split) { }
 			};
 
 			static const Type type;
@@ -312,8 +311,7 @@ namespace snabl {
 
 		struct SplitEnd {
 			struct Type: public OpType<SplitEnd> {
-				Type(const string &id): OpType<SplitEnd>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<SplitEnd>(id, OpCode::SplitEnd) { }
 			};
 
 			static const Type type;
@@ -321,8 +319,7 @@ namespace snabl {
 
 		struct Stack {
 			struct Type: public OpType<Stack> {
-				Type(const string &id): OpType<Stack>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Stack>(id, OpCode::Stack) { }
 			};
 
 			static const Type type;
@@ -332,8 +329,7 @@ namespace snabl {
 
 		struct Swap {
 			struct Type: public OpType<Swap> {
-				Type(const string &id): OpType<Swap>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Swap>(id, OpCode::Swap) { }
 			};
 
 			static const Type type;
@@ -341,8 +337,7 @@ namespace snabl {
 
 		struct Times {
 			struct Type: public OpType<Times> {
-				Type(const string &id): OpType<Times>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Times>(id, OpCode::Times) { }
 			};
 
 			static const Type type;
@@ -353,28 +348,105 @@ namespace snabl {
 
 		struct Try {
 			struct Type: public OpType<Try> {
-				Type(const string &id): OpType<Try>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<Try>(id, OpCode::Try) { }
 			};
 
 			static const Type type;
-			const Int state_reg;
 			Int handler_pc;
 
-			Try(Int state_reg): state_reg(state_reg), handler_pc(-1) { }
+			Try(): handler_pc(-1) { }
 		};
 
 		struct TryEnd {
 			struct Type: public OpType<TryEnd> {
-				Type(const string &id): OpType<TryEnd>(id) { }
-				OpImp make_imp(Env &env, Op &op) const override;
+				Type(const string &id): OpType<TryEnd>(id, OpCode::TryEnd) { }
 			};
 			
 			static const Type type;
-			const Int state_reg;
-			TryEnd(Int state_reg): state_reg(state_reg) { }
 		};
-	}	
+	}
+
+	using OpData = variant<ops::Call,
+										 ops::Case,
+										 ops::DDrop,
+										 ops::Drop,
+										 ops::Dup,
+										 ops::Else,
+										 ops::Eqval,
+										 ops::Fimp,
+										 ops::Funcall,
+										 ops::GetSlot,
+										 ops::Isa,
+										 ops::Jump,
+										 ops::JumpIf,
+										 ops::Lambda,
+										 ops::LetSlot,
+										 ops::Nop,
+										 ops::Push,
+										 ops::Recall,
+										 ops::Return,
+										 ops::Rot,
+										 ops::RSwap,
+										 ops::SDrop,
+										 ops::Split,
+										 ops::SplitEnd,
+										 ops::Stack,
+										 ops::Swap,
+										 ops::Times,
+										 ops::Try,
+										 ops::TryEnd>;
+	
+	struct Op {
+		const AOpType &type;
+		OpCode code;
+		const Pos pos;
+		PC next, branch;
+		Int depth;
+
+		Op(const Op &src)=delete;
+		
+		template <typename DataT, typename... ArgsT>
+		Op(const OpType<DataT> &type, Pos pos, ArgsT &&... args):
+			type(type),
+			code(type.code),
+			pos(pos),
+			next(nullptr),
+			branch(nullptr),
+			depth(-1),
+			_data(in_place_type<DataT>, forward<ArgsT>(args)...) { }
+
+		// Unchecked, callers have already dispatched on type or code
+		
+		template <typename DataT>
+		const DataT &as() const {
+			const auto p(get_if<DataT>(&_data));
+			if (!p) { __builtin_unreachable(); }
+			return *p;
+		}
+
+		template <typename DataT>
+		DataT &as() {
+			const auto p(get_if<DataT>(&_data));
+			if (!p) { __builtin_unreachable(); }
+			return *p;
+		}
+
+		template <typename DataT>
+		bool is() const { return holds_alternative<DataT>(_data); }
+
+		void dump(ostream &out) const {
+			out << type.id;
+			type.dump(*this, out);
+			out << endl;
+		}
+	private:
+		OpData _data;
+	};
+	
+	template <typename DataT>
+	void OpType<DataT>::dump(const Op &op, ostream &out) const {
+		dump_data(op.as<DataT>(), out);
+	}
 }
 
 #endif
@@ -0,0 +1,332 @@
+#include "snabl/env.hpp"
+#include "snabl/fimp.hpp"
+
+namespace snabl {
+	void Env::optimize(Int start_pc, Int end_pc) {
+		const Int n(end_pc-start_pc);
+		auto in_range([&](PC p) { return op_index(p, start_pc, end_pc) != -1; });
+
+		auto skip([&](PC p) {
+				for (Int i(0); in_range(p) && i < n; i++) {
+					const auto q(p->next);
+
+					if (p->code == OpCode::Nop) {
+						p = q;
+					} else if (p->code == OpCode::Jump) {
+						const auto pc(p->as<ops::Jump>().end_pc);
+						if (pc < start_pc || pc >= end_pc) { break; }
+						p = &_ops[pc];
+					} else if (in_range(q) &&
+										 ((p->code == OpCode::Push && q->code == OpCode::Drop) ||
+											(p->code == OpCode::Swap && q->code == OpCode::Swap))) {
+						p = q->next;
+					} else {
+						break;
+					}
+				}
+
+				return p;
+			});
+
+		auto target([&](Int pc) {
+				if (pc < start_pc || pc >= end_pc) { return pc; }
+				const auto p(skip(&_ops[pc]));
+				const auto i(op_index(p, start_pc, end_pc));
+				return (i == -1) ? pc : i;
+			});
+
+		Stack args;
+		
+		auto fold([&](Op &op) {
+				args.clear();
+				PC p(&op);
+
+				for (; in_range(p) && p->code == OpCode::Push; p = skip(p->next)) {
+					args.push_back(p->as<ops::Push>().val);
+				}
+
+				if (!in_range(p) || !p->is<ops::Funcall>()) { return false; }
+				const auto &o(p->as<ops::Funcall>());
+				if (o.rhs) { args.push_back(*o.rhs); }
+				if (Int(args.size()) != o.func->nargs) { return false; }
+				const FimpPtr *fimp(nullptr);
+				
+				if (o.fimp) {
+					if (o.fimp->score(args.data(), args.data()+args.size()) != -1) { fimp = &o.fimp; }
+				} else {
+					fimp = o.func->get_best_fimp(args.data(), args.data()+args.size());
+				}
+
+				if (!fimp || !(*fimp)->pure) { return false; }
+				const auto result(eval(*fimp, args, p->pos));
+				if (!result) { return false; }
+				replace(op, ops::Push::type, p->pos, *result).next = p->next;
+				return true;
+			});
+
+		// Folding back to front lets nested calls fold in the same pass
+		
+		for (bool done(false); !done;) {
+			done = true;
+			
+			for (Int pc(end_pc-1); pc >= start_pc; pc--) {
+				auto &op(_ops[pc]);
+				if (op.code == OpCode::Push && fold(op)) { done = false; }
+			}
+		}
+		
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			auto &op(_ops[pc]);
+			if (op.code != OpCode::Dup) { continue; }
+			const auto eq(skip(op.next));
+			if (!in_range(eq) || eq->code != OpCode::Eqval) { continue; }
+			const auto &rhs(eq->as<ops::Eqval>().rhs);
+			if (!rhs) { continue; }
+			const auto els(skip(eq->next));
+			if (!in_range(els) || els->code != OpCode::Else) { continue; }
+			const auto next(els->next);
+			
+			replace(op, ops::Case::type, op.pos,
+							*rhs, els->as<ops::Else>().skip_pc).next = next;
+		}
+
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			auto &op(_ops[pc]);
+			const auto next(skip(op.next));
+			if (!in_range(next)) { continue; }
+			
+			if (op.code == OpCode::Case && next->code == OpCode::Drop) {
+				const auto o(op.as<ops::Case>());
+				replace(op, ops::CaseDrop::type, op.pos, o.rhs, o.skip_pc).next = next->next;
+			} else if (op.code == OpCode::Push) {
+				const auto val(op.as<ops::Push>().val);
+				if (val.type() != int_type.get()) { continue; }
+				const ops::Funcall::Type *type(nullptr);
+				
+				switch (next->code) {
+				case OpCode::AddInt:
+					type = &ops::AddIntLit::type;
+					break;
+				case OpCode::LtInt:
+					type = &ops::LtIntLit::type;
+					break;
+				case OpCode::MulInt:
+					type = &ops::MulIntLit::type;
+					break;
+				case OpCode::SubInt:
+					type = &ops::SubIntLit::type;
+					break;
+				default:
+					continue;
+				}
+
+				const auto &o(next->as<ops::Funcall>());
+				const auto version(o.func_version);
+				auto &new_op(replace(op, *type, next->pos, o.func, val));
+				new_op.as<ops::Funcall>().func_version = version;
+				new_op.next = next->next;
+			}
+		}
+
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			auto &op(_ops[pc]);
+			op.next = skip(op.next);
+
+			switch (op.code) {
+			case OpCode::Case:
+			case OpCode::CaseDrop:
+			case OpCode::CaseDropUnchecked:
+			case OpCode::CaseUnchecked: {
+				auto &o(op.as<ops::Case>());
+				o.skip_pc = target(o.skip_pc);
+				break;
+			}
+			case OpCode::Else:
+			case OpCode::ElseUnchecked: {
+				auto &o(op.as<ops::Else>());
+				o.skip_pc = target(o.skip_pc);
+				break;
+			}
+			case OpCode::Fimp: {
+				auto &f(*op.as<ops::Fimp>().ptr);
+				f._start_pc = skip(f._start_pc);
+				f._end_pc = target(f._end_pc);
+				break;
+			}
+			case OpCode::Jump: {
+				auto &o(op.as<ops::Jump>());
+				o.end_pc = target(o.end_pc);
+				break;
+			}
+			case OpCode::JumpIf: {
+				auto &o(op.as<ops::JumpIf>());
+				o.end_pc = target(o.end_pc);
+				break;
+			}
+			case OpCode::Lambda: {
+				auto &o(op.as<ops::Lambda>());
+				o.start_pc = skip(o.start_pc);
+				o.end_pc = target(o.end_pc);
+				break;
+			}
+			case OpCode::Try: {
+				auto &o(op.as<ops::Try>());
+				o.handler_pc = target(o.handler_pc);
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+
+	void Env::tail_calls(Int start_pc, Int end_pc) {
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			auto &op(_ops[pc]);
+			
+			if (op.code == OpCode::Funcall && op.next && op.next->code == OpCode::Return) {
+				const auto o(op.as<ops::Funcall>());
+				replace(op, ops::TailCall::type, op.pos, o);
+			}
+		}
+	}
+
+	void Env::link(Int start_pc, Int end_pc) {
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			auto &op(_ops[pc]);
+			Int target(-1);
+			
+			switch (op.code) {
+			case OpCode::Case:
+			case OpCode::CaseDrop:
+			case OpCode::CaseDropUnchecked:
+			case OpCode::CaseUnchecked:
+				target = op.as<ops::Case>().skip_pc;
+				break;
+			case OpCode::Else:
+			case OpCode::ElseUnchecked:
+				target = op.as<ops::Else>().skip_pc;
+				break;
+			case OpCode::Fimp:
+				target = op.as<ops::Fimp>().ptr->_end_pc;
+				break;
+			case OpCode::Jump:
+				target = op.as<ops::Jump>().end_pc;
+				break;
+			case OpCode::JumpIf:
+				target = op.as<ops::JumpIf>().end_pc;
+				break;
+			case OpCode::Lambda:
+				target = op.as<ops::Lambda>().end_pc;
+				break;
+			case OpCode::Try:
+				target = op.as<ops::Try>().handler_pc;
+				break;
+			default:
+				if (op.is<ops::Funcall>()) {
+					auto &o(op.as<ops::Funcall>());
+					if (!o.cache) { o.cache = &_fimp_caches.emplace_back(); }
+				}
+				
+				continue;
+			}
+
+			if (target < _ops.size()) {
+				op.branch = &_ops[target];
+			} else {
+				op.branch = nullptr;
+				_unlinked.push_back(&op);
+			}
+		}
+	}
+
+	optional<Box> Env::eval(const FimpPtr &fimp, const Stack &args, Pos pos) {
+		auto &stack(_task->_stack);
+		const auto offs(stack.size());
+		const auto ncalls(_task->_calls.size());
+		for (auto &a: args) { stack.push_back(a); }
+
+		try {
+			Fimp::call(fimp, pos);
+		} catch (const Error &) {
+			_task->_calls.trunc(ncalls);
+			stack.trunc(offs);
+			return nullopt;
+		}
+
+		optional<Box> out;
+		if (stack.size() == offs+1) { out = stack.back(); }
+		stack.trunc(offs);
+		return out;
+	}
+
+	vector<Int> Env::live_ops(Int start_pc, Int end_pc) const {
+		vector<bool> live(end_pc-start_pc, false);
+		vector<Int> todo;
+
+		auto mark([&](Int pc) {
+				if (pc >= start_pc && pc < end_pc && !live[pc-start_pc]) {
+					live[pc-start_pc] = true;
+					todo.push_back(pc);
+				}
+			});
+
+		auto mark_ptr([&](PC p) { mark(op_index(p, start_pc, end_pc)); });
+
+		mark(start_pc);
+
+		while (!todo.empty()) {
+			const auto &op(_ops[todo.back()]);
+			todo.pop_back();
+
+			switch (op.code) {
+			case OpCode::Case:
+			case OpCode::CaseDrop:
+			case OpCode::CaseDropUnchecked:
+			case OpCode::CaseUnchecked:
+				mark(op.as<ops::Case>().skip_pc);
+				break;
+			case OpCode::Else:
+			case OpCode::ElseUnchecked:
+				mark(op.as<ops::Else>().skip_pc);
+				break;
+			case OpCode::Fimp: {
+				const auto &f(*op.as<ops::Fimp>().ptr);
+				mark_ptr(f._start_pc);
+				mark(f._end_pc);
+				continue;
+			}
+			case OpCode::Jump:
+				mark(op.as<ops::Jump>().end_pc);
+				continue;
+			case OpCode::JumpIf:
+				mark(op.as<ops::JumpIf>().end_pc);
+				break;
+			case OpCode::Lambda: {
+				const auto &o(op.as<ops::Lambda>());
+				mark_ptr(o.start_pc);
+				mark(o.end_pc);
+				continue;
+			}
+			case OpCode::Recall:
+			case OpCode::Return:
+				continue;
+			case OpCode::Try:
+				mark(op.as<ops::Try>().handler_pc);
+				break;
+			default:
+				break;
+			}
+
+			mark_ptr(op.next);
+		}
+
+		vector<Int> out;
+
+		for (Int pc(start_pc); pc < end_pc; pc++) {
+			if (live[pc-start_pc]) { out.push_back(pc); }
+		}
+
+		return out;
+	}
+}
@@ -5,16 +5,40 @@
 
 namespace snabl {
 	const Pos Parser::init_pos(1, 0);
+	/* Forms take 12-16 arena bytes per input byte. The first block covers a
+		 fraction of that, and the arena grows in capped chunks, so large inputs
+		 never hold much more than they use. */
 	
+	const size_t Parser::arena_ratio(2);
+
+	Parser::Parser(Env &env, Arena &arena):
+		env(env), _arena(arena), _pos(init_pos), _ptr(nullptr), _end(nullptr) {
+		_separators.fill(false);
+		for (auto c: env.separators) { _separators[uint8_t(c)] = true; }
+	}
+	
+	void Parser::parse(string_view in, Forms &out) {
+		_ptr = in.data();
+		_end = _ptr+in.size();
+		_forms.clear();
+		parse(init_pos, 0);
+		out = pop(0);
+	}
+
 	void Parser::parse(istream &in, Forms &out) {
-		parse(in, init_pos, 0, out);
+		stringstream buf;
+		buf << in.rdbuf();
+		const auto s(buf.str());
+		parse(string_view(s), out);
 	}
 
-	bool Parser::parse(istream &in, Pos start_pos, char end, Forms &out) {
+	bool Parser::parse(Pos start_pos, char end) {
 		_pos = start_pos;
-		char c;
+		const auto offs(_forms.size());
 		
-		while (in.get(c)) {
+		while (_ptr != _end) {
+			const char c(*_ptr++);
+			
 			if (c == end) {
 				_pos.col++;
 				return true;
@@ -31,74 +55,56 @@ namespace snabl {
 				break;
 			case ',':
 				_pos.col++;
-				return parse_body<forms::Comma>(in, end, out);
+				return parse_body<forms::Comma>(end);
 			case ';':
 				_pos.col++;
-				return parse_body<forms::Semi>(in, end, out);
+				return parse_body<forms::Semi>(end);
 			case '?': {
-				if (out.empty()) { throw CompileError(start_pos, "Nothing to query"); }
-				auto form(out.back());
-				out.pop_back();
-				out.emplace_back(forms::Query::type, _pos, form);
+				if (_forms.size() == offs) { throw CompileError(start_pos, "Nothing to query"); }
+				const auto form(_forms.back());
+				_forms.pop_back();
+				push(forms::Query::type, _pos, form);
 				_pos.col++;
 				break;
 			}
 			case '(':
 				_pos.col++;
-				parse_sexpr(in, out);
+				parse_sexpr();
 				break;
 			case '{':
 				_pos.col++;
-				parse_lambda(in, out);
+				parse_lambda();
 				break;
 			case '[':
 				_pos.col++;
-				parse_stack(in, out);
+				parse_stack();
 				break;
 			case '~':
 				_pos.col++;
-				parse_special_char(in, out);
+				parse_special_char();
 				break;
 			case '#':
 				_pos.col++;
-				parse_char(in, out);
+				parse_char();
 				break;
-			case '\'': {
-				char nc(0);
-				
-				if (in.get(nc) && nc == '\'') {
+			case '\'':
+				if (_ptr != _end && *_ptr == '\'') {
+					_ptr++;
 					_pos.col += 2;
-					parse_str(in,out);
+					parse_str();
 				} else {
-					in.clear();
-					if (nc) { in.putback(nc); }
-					in.putback(c);
-					parse_id(in, out);
+					_ptr--;
+					parse_id();
 				}
 
 				break;
-			}
 			default:
-				bool is_num = isdigit(c);
-
-				if (c == '-') {
-					char nc;
-					
-					if (in.get(nc)) {
-						in.clear();
-						in.putback(nc);
-						is_num |= isdigit(nc);
-					}
-				}
-				
-				if (is_num) {
-					in.clear();
-					in.putback(c);
-					parse_num(in, out);
+				if (isdigit(c) || (c == '-' && _ptr != _end && isdigit(*_ptr))) {
+					_ptr--;
+					parse_num();
 				} else if (isgraph(c)) {
-					in.clear();
-					in.putback(c);
-					parse_id(in, out);
+					_ptr--;
+					parse_id();
 				} else {
 					throw Error("Invalid input");
 				}
@@ -108,169 +114,144 @@ namespace snabl {
 		return false;
 	}
 	
-	void Parser::parse_id(istream &in, Forms &out) {
+	void Parser::parse_id() {
 		const auto start_pos(_pos);
-		stringstream buf;
-		char c, pc(0);
-		bool pc_sep;
+		const auto start(_ptr);
+		char pc(0);
+		bool pc_sep(false);
 		
-		while (in.get(c)) {
-			bool c_sep(env.separators.find(c) != env.separators.end());
-			
-			if (c != ' ' && c != '\n' && (!pc || (!c_sep && !pc_sep) || c == pc)) {
-				buf << c;
-				_pos.col++;
-			} else {
-				break;
-			}
-
+		for (; _ptr != _end; _ptr++, _pos.col++) {
+			const char c(*_ptr);
+			const bool c_sep(is_separator(c));
+			if (c == ' ' || c == '\n' || (pc && (c_sep || pc_sep) && c != pc)) { break; }
 			pc = c;
 			pc_sep = c_sep;
-			c = 0;
 		}
 
-		const auto id(buf.str());
+		const string_view id(start, _ptr-start);
 		
 		if (id.front() == '\'') {
-			out.emplace_back(forms::Lit::type,
-											 start_pos,
-											 Box(env.sym_type, env.sym(id.substr(1))));
-		} else if (c == '<') {
-			parse_fimp(start_pos, env.sym(buf.str()), in, out);
-			c = 0;
+			push(forms::Lit::type, start_pos, Box(env.sym_type, env.sym(id.substr(1))));
+		} else if (_ptr != _end && *_ptr == '<') {
+			_ptr++;
+			parse_fimp(start_pos, env.sym(id));
 		} else {
-			out.emplace_back(forms::Id::type, start_pos, env.sym(id));
-		}
-
-		if (c) {
-			in.clear();
-			in.putback(c);
+			push(forms::Id::type, start_pos, env.sym(id));
 		}
 	}
 
-	void Parser::parse_lambda(istream &in, Forms &out) {
+	void Parser::parse_lambda() {
 		const auto start_pos(_pos);
 
-		if (!parse_body<forms::Lambda>(in, '}', out)) {
+		if (!parse_body<forms::Lambda>('}')) {
 			throw SyntaxError(start_pos, "Open lambda");
 		}
 	}
 
-	void Parser::parse_num(istream &in, Forms &out) {
+	void Parser::parse_num() {
 		const auto start_pos(_pos);
-		stringstream buf;
+		const auto start(_ptr);
 		bool is_float(false);
-		char c;
 		
-		while (in.get(c)) {
+		for (; _ptr != _end; _ptr++, _pos.col++) {
+			const char c(*_ptr);
+			
 			if (c == '.') {
-				char nc;
-				
-				if (in.get(nc) && nc == '.') {
-					in.clear();
-					in.putback('.');
-					in.putback('.');
-					break;
-				}
-
+				if (_ptr+1 != _end && *(_ptr+1) == '.') { break; }
 				is_float = true;
-				buf << '.';
-				_pos.col++;
-			} else if (isdigit(c) || c == '-') {
-				buf << c;
-				_pos.col++;
-			} else {
-				in.clear();
-				in.putback(c);
+			} else if (!isdigit(c) && (c != '-' || _ptr != start)) {
 				break;
 			}
 		}
-	 
-		out.emplace_back(forms::Lit::type,
-										 start_pos,
-										 is_float
-										 ? Box(env.float_type, stold(buf.str()))
-										 : Box(env.int_type, stoll(buf.str())));
+
+		if (is_float) {
+			Float v(0);
+			const auto r(from_chars(start, _ptr, v));
+			
+			if (r.ec != errc() || r.ptr != _ptr) {
+				throw SyntaxError(start_pos, "Invalid number");
+			}
+
+			push(forms::Lit::type, start_pos, Box(env.float_type, v));
+		} else {
+			Int v(0);
+			const auto r(from_chars(start, _ptr, v));
+			
+			if (r.ec != errc() || r.ptr != _ptr) {
+				throw SyntaxError(start_pos, "Invalid number");
+			}
+
+			push(forms::Lit::type, start_pos, Box(env.int_type, v));
+		}
 	}
 
-	void Parser::parse_sexpr(istream &in, Forms &out) {
+	void Parser::parse_sexpr() {
 		const auto start_pos(_pos);
 
-		if (!parse_body<forms::Sexpr>(in, ')', out)) {
+		if (!parse_body<forms::Sexpr>(')')) {
 			throw SyntaxError(start_pos, "Open sexpr");
 		}
 	}
 
-	void Parser::parse_stack(istream &in, Forms &out) {
+	void Parser::parse_stack() {
 		const auto start_pos(_pos);
 
-		if (!parse_body<forms::Stack>(in, ']', out)) {
+		if (!parse_body<forms::Stack>(']')) {
 			throw SyntaxError(start_pos, "Open stack");
 		}
 	}
 	
-	void Parser::parse_special_char(istream &in, Forms &out) {
+	void Parser::parse_special_char() {
 		auto p(_pos);
 		p.col--;
 
-		char c(0);
-		if (!in.get(c)) { throw SyntaxError(p, "Missing special char"); }
+		if (_ptr == _end) { throw SyntaxError(p, "Missing special char"); }
+		const char c(*_ptr++);
 		auto sc(env.find_special_char(c));
 		if (!sc) { throw SyntaxError(p, fmt("Unknown special char: %0", {c})); }
-		out.emplace_back(forms::Lit::type, p, Box(env.char_type, *sc));
+		push(forms::Lit::type, p, Box(env.char_type, *sc));
 	}
 
-	void Parser::parse_char(istream &in, Forms &out) {
+	void Parser::parse_char() {
 		auto p(_pos);
 		p.col--;
 
-		char c(0);
-		if (!in.get(c)) { throw SyntaxError(p, "Missing char"); }
-		out.emplace_back(forms::Lit::type, p, Box(env.char_type, Char(c)));
+		if (_ptr == _end) { throw SyntaxError(p, "Missing char"); }
+		const char c(*_ptr++);
+		push(forms::Lit::type, p, Box(env.char_type, Char(c)));
 	}
 
-	void Parser::parse_str(istream &in, Forms &out) {
+	void Parser::parse_str() {
 		auto p(_pos);
 		p.col--;
-		stringstream s;
-		char c(0);
+		const auto start(_ptr);
+
+		/* A single quote takes the next char with it, only a pair closes the
+			 string. */
 		
-		while (in.get(c)) {
-			if (c == '\'') {
-				char nc(0);
-				
-				if (in.get(nc) && nc == '\'') {
-					_pos.col++;
-					break;
-				}
-				else {
-					s << c;
-					
-					if (nc) {
-						_pos.col++;
-						s << nc;
-					}
-				}
+		for (;;) {
+			if (_ptr == _end || (*_ptr == '\'' && _ptr+1 == _end)) {
+				throw SyntaxError(p, "Open string");
+			}
 
-				_pos.col++;
+			if (*_ptr != '\'') {
+				_ptr++;
+			} else if (*(_ptr+1) == '\'') {
+				break;
 			} else {
-				s << c;
+				_ptr += 2;
 			}
-
-			_pos.col++;
-			c = 0;
 		}
 
-		if (!c) { throw SyntaxError(p, "Open string"); }
-		
-		out.emplace_back(forms::Lit::type, p,
-										 Box(env.str_type, make_shared<Str>(s.str())));
+		const string_view s(start, _ptr-start);
+		_ptr += 2;
+		_pos.col += s.size()+2;
+		push(forms::Lit::type, p, Box(env.str_type, make_shared<Str>(s)));
 	}
 
-	void Parser::parse_fimp(Pos pos, Sym id, istream &in, Forms &out) {
-		Forms body;
-		if (!parse(in, pos, '>', body)) { throw SyntaxError(pos, "Open fimp"); }
-		out.emplace_back(forms::Fimp::type, pos, id, body.cbegin(), body.cend());
+	void Parser::parse_fimp(Pos pos, Sym id) {
+		const auto offs(_forms.size());
+		if (!parse(pos, '>')) { throw SyntaxError(pos, "Open fimp"); }
+		push(forms::Fimp::type, pos, id, pop(offs));
 	}
-
 }
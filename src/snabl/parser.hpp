@@ -1,6 +1,7 @@
 #ifndef SNABL_PARSER_HPP
 #define SNABL_PARSER_HPP
 
+#include "snabl/arena.hpp"
 #include "snabl/form.hpp"
 #include "snabl/pos.hpp"
 
@@ -10,32 +11,53 @@ namespace snabl {
 	class Parser {
 	public:
 		static const Pos init_pos;
+		static const size_t arena_ratio;
 		Env &env;
 		
-		Parser(Env &env): env(env), _pos(init_pos) { }
+		Parser(Env &env, Arena &arena);
+		void parse(string_view in, Forms &out);
 		void parse(istream &in, Forms &out);
-		bool parse(istream &in, Pos start_pos, char end, Forms &out);		
 	private:
+		Arena &_arena;
 		Pos _pos;
+		const char *_ptr, *_end;
+		array<bool, 256> _separators;
+		vector<Form> _forms;
 
+		bool parse(Pos start_pos, char end);		
+
+		template <typename ImpT, typename... ArgsT>
+		void push(const FormType<ImpT> &type, Pos pos, ArgsT &&... args) {
+			_forms.emplace_back(type, pos, _arena.make<ImpT>(forward<ArgsT>(args)...));
+		}
+
+		Forms pop(size_t offs) {
+			const auto p(_arena.copy<Form>(_forms.begin()+offs, _forms.end()));
+			const Forms out(p, p+(_forms.size()-offs));
+			while (_forms.size() > offs) { _forms.pop_back(); }
+			return out;
+		}
+		
 		template <typename FormT>
-		bool parse_body(istream &in, char end, Forms &out) {
+		bool parse_body(char end) {
 			auto start_pos(_pos);
-			Forms body;
-			if (!parse(in, start_pos, end, body) && end) { return false; }
-			out.emplace_back(FormT::type, start_pos, body.cbegin(), body.cend());
+			const auto offs(_forms.size());
+			if (!parse(start_pos, end) && end) { return false; }
+			push(FormT::type, start_pos, pop(offs));
 			return true;
 		}
 
-		void parse_id(istream &in, Forms &out);
-		void parse_lambda(istream &in, Forms &out);
-		void parse_num(istream &in, Forms &out);
-		void parse_sexpr(istream &in, Forms &out);
-		void parse_stack(istream &in, Forms &out);
-		void parse_special_char(istream &in, Forms &out);
-		void parse_char(istream &in, Forms &out);
-		void parse_str(istream &in, Forms &out);
-		void parse_fimp(Pos pos, Sym id, istream &in, Forms &out);
+		bool is_separator(char c) const { return _separators[uint8_t(c)]; }
+		
+		void parse_id();
+		void parse_lambda();
+		void parse_num();
+		void parse_sexpr();
+		void parse_stack();
+		void parse_special_char();
+		void parse_char();
+		void parse_str();
+		void parse_fimp(Pos pos, Sym id);
 	};
 }
 
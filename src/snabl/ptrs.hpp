@@ -40,8 +40,8 @@ namespace snabl {
 	class UserError;
 	using ErrorPtr = shared_ptr<UserError>;
 
-	using OpImp = function<void ()>;
-	using PC = const OpImp *;
+	struct Op;
+	using PC = Op *;
 }
 
 #endif
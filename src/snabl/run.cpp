@@ -1,21 +1,14 @@
 #include "snabl/call.hpp"
 #include "snabl/env.hpp"
+#include "snabl/fimp.hpp"
+#include "snabl/lambda.hpp"
 #include "snabl/parser.hpp"
 #include "snabl/run.hpp"
 
 namespace snabl {
 	void Env::run(string_view in) {
-		const string s(in);
-		istringstream ss(s);
-		run(ss);
-	}
-
-	void Env::run(istream &in) {
-		Forms fs;
-		Parser(*this).parse(in, fs);
-
 		const auto start_pc(_ops.size());
-		compile(fs.begin(), fs.end());
+		compile(in);
 		
 		if (!_ops.empty()) {
 			jump(start_pc);
@@ -23,46 +16,539 @@ namespace snabl {
 		}
 	}
 
+	void Env::run(istream &in) {
+		stringstream buf;
+		buf << in.rdbuf();
+		run(string_view(buf.str()));
+	}
+
+	[[noreturn]] static void nothing_to(Env &env, Pos pos, const char *id) {
+		throw RuntimeError(env, pos, fmt("Nothing to %0", {id}));
+	}
+	
+	inline const FimpPtr &Env::get_fimp(ops::Funcall &op, Pos pos) {
+		const FimpPtr *fimp(nullptr);
+		
+		if (op.typed_fimp && op.typed_version == op.func->version()) {
+			fimp = &op.typed_fimp;
+		} else if (Int(_task->_stack.size()) >= _stack_offs+op.func->nargs) {
+			const auto &stack(_task->_stack);
+			const auto args(stack.end()-op.func->nargs);
+			
+			if (op.fimp) {
+				fimp = &op.fimp;
+				
+				if (op.func->nargs &&
+						op.fimp->score(args, stack.end()) == -1) { fimp = nullptr; }
+			} else {
+				fimp = op.cache->get(*op.func, args, stack.end(), _fimp_cache_stats);
+			}
+		}	
+		
+		if (!fimp) {
+			throw RuntimeError(*this, pos, fmt("Func not applicable: %0", {op.func->id}));
+		}
+
+		return *fimp;
+	}
+
+	inline bool Env::check_func_op(Op &op) {
+		auto &o(op.as<ops::Funcall>());
+		const auto v(o.func->version());
+		if (o.func_version == v) { return true; }
+		if (&func_op(o.func) == &ops::Funcall::type) { return false; }
+		o.func_version = v;
+		return true;
+	}
+	
 	void Env::run() {
-	enter:		
+		auto &pc(_task->_pc);
+		auto &stack(_task->_stack);
+	enter:
 		try {
-			while (_task->_pc) { (*_task->_pc)(); }
+			while (pc) {
+				auto &op(*pc);
+				
+				switch (op.code) {
+				case OpCode::AddInt: {
+					if (Int(stack.size()) < _stack_offs+2 || !check_func_op(op)) {
+						goto funcall;
+					}
+					
+					auto &y(stack.back()), &x(*(&y-1));
+					if (x.type() != int_type.get() || y.type() != int_type.get()) {
+						goto funcall;
+					}
+
+					x.as<Int>() += y.as<Int>();
+					stack.pop_back();
+					pc = op.next;
+					break;
+				}
+				case OpCode::AddIntLit: {
+					const auto &rhs(*op.as<ops::Funcall>().rhs);
+					
+					if (Int(stack.size()) <= _stack_offs ||
+							stack.back().type() != int_type.get() ||
+							!check_func_op(op)) {
+						stack.push_back(rhs);
+						goto funcall;
+					}
+
+					stack.back().as<Int>() += rhs.as<Int>();
+					pc = op.next;
+					break;
+				}
+				case OpCode::Call: {
+					pc = op.next;
+					const Box v(pop());
+					v.call(op.pos, false);
+					break;
+				}
+				case OpCode::Case:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "case"); }
+					[[fallthrough]];
+				case OpCode::CaseUnchecked: {
+					const auto &o(op.as<ops::Case>());
+					
+					if (stack.back().eqval(o.rhs)) {
+						pc = op.next;
+					} else {
+						pc = op.branch;
+					}
+
+					break;
+				}
+				case OpCode::CaseDrop:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "case"); }
+					[[fallthrough]];
+				case OpCode::CaseDropUnchecked: {
+					const auto &o(op.as<ops::Case>());
+					
+					if (stack.back().eqval(o.rhs)) {
+						stack.pop_back();
+						pc = op.next;
+					} else {
+						pc = op.branch;
+					}
+
+					break;
+				}
+				case OpCode::DDrop:
+					if (Int(stack.size()) <= _stack_offs+1) { nothing_to(*this, op.pos, "ddrop"); }
+					[[fallthrough]];
+				case OpCode::DDropUnchecked:
+					stack.pop_back();
+					stack.pop_back();
+					pc = op.next;
+					break;
+				case OpCode::DecInt: {
+					if (Int(stack.size()) <= _stack_offs || !check_func_op(op)) {
+						goto funcall;
+					}
+					
+					auto &x(stack.back());
+					if (x.type() != int_type.get()) { goto funcall; }
+					--x.as<Int>();
+					pc = op.next;
+					break;
+				}
+				case OpCode::Drop:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "drop"); }
+					[[fallthrough]];
+				case OpCode::DropUnchecked:
+					stack.pop_back();
+					pc = op.next;
+					break;
+				case OpCode::Dup:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "dup"); }
+					[[fallthrough]];
+				case OpCode::DupUnchecked:
+					stack.push_back(stack.back());
+					pc = op.next;
+					break;
+				case OpCode::Else:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "else"); }
+					[[fallthrough]];
+				case OpCode::ElseUnchecked: {
+					const auto &v(stack.back());
+
+					if (v.type() != bool_type.get()) {
+						throw RuntimeError(*this, op.pos, fmt("Invalid else cond: %0", {v}));
+					}
+
+					if (v.as<bool>()) {
+						pc = op.next;
+					} else {
+						pc = op.branch;
+					}
+
+					stack.pop_back();
+					break;
+				}
+				case OpCode::Eqval: {
+					const auto &o(op.as<ops::Eqval>());
+				
+					if (Int(stack.size()) <= _stack_offs+(o.rhs ? 0 : 1)) {
+						nothing_to(*this, op.pos, "eqval");
+					}
+
+					auto &lhs(stack.back());
+					lhs = Box(bool_type, lhs.eqval(o.rhs ? *o.rhs : *(&lhs-1)));
+					pc = op.next;
+					break;
+				}
+				case OpCode::Fimp: {
+					auto &fimp(*op.as<ops::Fimp>().ptr);
+				
+					if (fimp._opts & Target::Opts::Regs || fimp._opts & Target::Opts::Vars) {
+						fimp._parent_scope = _scope;
+					}
+				
+					pc = op.branch;
+					break;
+				}
+				case OpCode::Funcall:
+				funcall: {
+					const auto &fimp(get_fimp(op.as<ops::Funcall>(), op.pos));
+					pc = op.next;
+					snabl::Fimp::call(fimp, op.pos);
+					break;
+				}
+				case OpCode::GetSlot: {
+					const auto &o(op.as<ops::GetSlot>());
+					auto v(_scope->get(o.depth, o.slot));
+					
+					if (!v) {
+						throw RuntimeError(*this, op.pos, fmt("Unknown var: %0", {o.id}));
+					}
+
+					stack.push_back(*v);
+					pc = op.next;
+					break;
+				}
+				case OpCode::IncInt: {
+					if (Int(stack.size()) <= _stack_offs || !check_func_op(op)) {
+						goto funcall;
+					}
+					
+					auto &x(stack.back());
+					if (x.type() != int_type.get()) { goto funcall; }
+					++x.as<Int>();
+					pc = op.next;
+					break;
+				}
+				case OpCode::Isa:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "isa"); }
+					[[fallthrough]];
+				case OpCode::IsaUnchecked: {
+					auto &v(stack.back());
+					v = Box(bool_type, v.isa(op.as<ops::Isa>().rhs));
+					pc = op.next;
+					break;
+				}
+				case OpCode::Jump:
+					pc = op.branch;
+					break;
+				case OpCode::JumpIf:
+					if (!get_reg<Int>(op.as<ops::JumpIf>().i_reg)--) {
+						pc = op.branch;
+					} else {
+						pc = op.next;
+					}
+
+					break;
+				case OpCode::Lambda: {
+					const auto &o(op.as<ops::Lambda>());
+				
+					push(lambda_type,
+							 make_shared<snabl::Lambda>((o.opts & Target::Opts::Regs ||
+																					 o.opts & Target::Opts::Vars)
+																					? _scope
+																					: nullptr,
+																					o.start_pc, o.end_pc,
+																					o.opts, o.nvars));
+					pc = op.branch;
+					break;
+				}
+				case OpCode::LetSlot:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "let"); }
+					[[fallthrough]];
+				case OpCode::LetSlotUnchecked: {
+					const auto &o(op.as<ops::LetSlot>());
+					_scope->let(o.id, o.slot, stack.back());
+					stack.pop_back();
+					pc = op.next;
+					break;
+				}
+				case OpCode::LtInt: {
+					if (Int(stack.size()) < _stack_offs+2 || !check_func_op(op)) {
+						goto funcall;
+					}
+					
+					auto &y(stack.back()), &x(*(&y-1));
+					if (x.type() != int_type.get() || y.type() != int_type.get()) {
+						goto funcall;
+					}
+
+					x = Box(bool_type, x.as<Int>() < y.as<Int>());
+					stack.pop_back();
+					pc = op.next;
+					break;
+				}
+				case OpCode::LtIntLit: {
+					const auto &rhs(*op.as<ops::Funcall>().rhs);
+					
+					if (Int(stack.size()) <= _stack_offs ||
+							stack.back().type() != int_type.get() ||
+							!check_func_op(op)) {
+						stack.push_back(rhs);
+						goto funcall;
+					}
+
+					auto &x(stack.back());
+					x = Box(bool_type, x.as<Int>() < rhs.as<Int>());
+					pc = op.next;
+					break;
+				}
+				case OpCode::MulInt: {
+					if (Int(stack.size()) < _stack_offs+2 || !check_func_op(op)) {
+						goto funcall;
+					}
+					
+					auto &y(stack.back()), &x(*(&y-1));
+					if (x.type() != int_type.get() || y.type() != int_type.get()) {
+						goto funcall;
+					}
+
+					x.as<Int>() *= y.as<Int>();
+					stack.pop_back();
+					pc = op.next;
+					break;
+				}
+				case OpCode::MulIntLit: {
+					const auto &rhs(*op.as<ops::Funcall>().rhs);
+					
+					if (Int(stack.size()) <= _stack_offs ||
+							stack.back().type() != int_type.get() ||
+							!check_func_op(op)) {
+						stack.push_back(rhs);
+						goto funcall;
+					}
+
+					stack.back().as<Int>() *= rhs.as<Int>();
+					pc = op.next;
+					break;
+				}
+				case OpCode::Nop:
+					pc = op.next;
+					break;
+				case OpCode::Push:
+					stack.push_back(op.as<ops::Push>().val);
+					pc = op.next;
+					break;
+				case OpCode::Recall:
+					recall(op.pos);
+					break;
+				case OpCode::Return:
+					_return(op.pos);
+					break;
+				case OpCode::Rot:
+					if (Int(stack.size()) <= _stack_offs+2) { nothing_to(*this, op.pos, "rot"); }
+					[[fallthrough]];
+				case OpCode::RotUnchecked: {
+					auto i(stack.end()-1);
+					swap(*i, *(i-2));
+					swap(*i, *(i-1));
+					pc = op.next;
+					break;
+				}
+				case OpCode::RSwap:
+					if (Int(stack.size()) <= _stack_offs+2) { nothing_to(*this, op.pos, "rswap"); }
+					[[fallthrough]];
+				case OpCode::RSwapUnchecked: {
+					auto i(stack.end()-1);
+					swap(*i, *(i-2));
+					pc = op.next;
+					break;
+				}
+				case OpCode::SDrop:
+					if (Int(stack.size()) <= _stack_offs+1) { nothing_to(*this, op.pos, "sdrop"); }
+					[[fallthrough]];
+				case OpCode::SDropUnchecked: {
+					auto i(stack.end()-1);
+					*(i-1) = *i;
+					stack.pop_back();
+					pc = op.next;
+					break;
+				}
+				case OpCode::Split:
+					begin_split();
+					pc = op.next;
+					break;
+				case OpCode::SplitEnd:
+					end_split();
+					pc = op.next;
+					break;
+				case OpCode::Stack: {
+					const Int offs(_stack_offs);
+					if (op.as<ops::Stack>().end_split) { end_split(); }
+					auto s(make_shared<snabl::Stack>());
+				
+					if (Int(stack.size()) > offs) {
+						move(stack.begin()+offs, stack.end(), back_inserter(*s));
+						stack.trunc(offs);
+					}
+				
+					push(stack_type, s);
+					pc = op.next;
+					break;
+				}
+				case OpCode::SubInt: {
+					if (Int(stack.size()) < _stack_offs+2 || !check_func_op(op)) {
+						goto funcall;
+					}
+					
+					auto &y(stack.back()), &x(*(&y-1));
+					if (x.type() != int_type.get() || y.type() != int_type.get()) {
+						goto funcall;
+					}
+
+					x.as<Int>() -= y.as<Int>();
+					stack.pop_back();
+					pc = op.next;
+					break;
+				}
+				case OpCode::SubIntLit: {
+					const auto &rhs(*op.as<ops::Funcall>().rhs);
+					
+					if (Int(stack.size()) <= _stack_offs ||
+							stack.back().type() != int_type.get() ||
+							!check_func_op(op)) {
+						stack.push_back(rhs);
+						goto funcall;
+					}
+
+					stack.back().as<Int>() -= rhs.as<Int>();
+					pc = op.next;
+					break;
+				}
+				case OpCode::Swap:
+					if (Int(stack.size()) <= _stack_offs+1) { nothing_to(*this, op.pos, "swap"); }
+					[[fallthrough]];
+				case OpCode::SwapUnchecked: {
+					auto i(stack.end()-1);
+					swap(*i, *(i-1));
+					pc = op.next;
+					break;
+				}
+				case OpCode::TailCall: {
+					const auto &fimp(get_fimp(op.as<ops::Funcall>(), op.pos));
+					
+					if (_task->_calls.size()) {
+						_return(op.pos);
+					} else {
+						pc = op.next;
+					}
+
+					snabl::Fimp::call(fimp, op.pos);
+					break;
+				}
+				case OpCode::Throw: {
+					if (Int(stack.size()) <= _stack_offs ||
+							!stack.back().isa(root_type) ||
+							!check_func_op(op)) { goto funcall; }
+					const auto val(stack.back());
+					stack.pop_back();
+
+					if (val.type() == error_type.get()) {
+						const auto &e(val.as<ErrorPtr>());
+						if (!catch_error(e)) { throw *e; }
+					} else if (!catch_error(make_shared<UserError>(*this, op.pos, val))) {
+						throw UserError(*this, op.pos, val);
+					}
+					
+					break;
+				}
+				case OpCode::Times:
+					if (Int(stack.size()) <= _stack_offs) { nothing_to(*this, op.pos, "times"); }
+					[[fallthrough]];
+				case OpCode::TimesUnchecked:
+					let_reg(op.as<ops::Times>().i_reg, stack.back().as<Int>());
+					stack.pop_back();
+					pc = op.next;
+					break;
+				case OpCode::Try:
+					begin_try(op);
+					pc = op.next;
+					break;
+				case OpCode::TryEnd:
+					end_try();
+					pc = op.next;
+					break;
+				}
+			}
 		} catch (const UserError &e) {
-			if (!_task->_tries.size()) { throw e; }
-			auto t(_task->_tries.back());
-			auto &s(get_reg<State>(t->state_reg));			
-			s.restore_lib(*this);
-			s.restore_scope(*this);
-			s.restore_calls(*this);
-			s.restore_stack(*this);
-			s.restore_splits(*this);
-			clear_reg(t->state_reg);
-			end_try();
-			
-			push(error_type, make_shared<UserError>(e));
-			jump(t->handler_pc);
+			if (!catch_error(make_shared<UserError>(e))) { throw; }
 			goto enter;
 		}
 	}
-	
-	RuntimeError::RuntimeError(Env &env, Pos pos, const string &msg) {
-		stringstream buf;
-				
-		buf << env._stack << endl
-				<< "Error in row " << pos.row << ", col " << pos.col << ":\n"
-				<< msg;
-		
-		_what = buf.str();
+
+	bool Env::catch_error(const ErrorPtr &e) {
+		auto &tries(_task->_tries);
+		if (!tries.size()) { return false; }
+		const auto &t(tries.back());
+		const auto &s(t.state);
+		s.restore_lib(*this);
+		s.restore_scope(*this);
+		s.restore_calls(*this);
+		s.restore_stack(*this);
+		s.restore_splits(*this);
+		jump(t.op.branch);
+		end_try();
+		push(error_type, e);
+		return true;
 	}
 
-	const char *RuntimeError::what() const noexcept { return _what.c_str(); }
+	RuntimeError::RuntimeError(Env &env, Pos pos, const string &msg):
+		RuntimeError(env, pos) { _msg = msg; }
 
-	static string val_str(const Box &val) {
-		stringstream buf;
-		buf << val;
-		return buf.str();
+	RuntimeError::RuntimeError(Env &env, Pos pos):
+		pos(pos), _nstack(env.stack().size()) {
+		const auto n(min(_nstack, env.max_error_items));
+		_stack.assign(env.stack().end()-n, env.stack().end());
 	}
+
+	const char *RuntimeError::what() const noexcept {
+		if (_what.empty()) {
+			stringstream buf;
+			buf << '[';
+			char sep(0);
+
+			if (_nstack > Int(_stack.size())) {
+				buf << "...";
+				sep = ' ';
+			}
+			
+			for (auto &v: _stack) {
+				if (sep) { buf << sep; }
+				v.dump(buf);
+				sep = ' ';
+			}
+			
+			buf << ']' << endl
+					<< "Error in row " << pos.row << ", col " << pos.col << ":\n";
+			dump_msg(buf);
+			_what = buf.str();
+		}
+		
+		return _what.c_str();
+	}
+
+	void RuntimeError::dump_msg(ostream &out) const { out << _msg; }
 	
 	UserError::UserError(Env &env, Pos pos, const Box &_val):
-		RuntimeError(env, pos, val_str(_val)), val(_val) { }
+		RuntimeError(env, pos), val(_val) { }
+
+	void UserError::dump_msg(ostream &out) const { out << val; }
 }
@@ -9,16 +9,25 @@ namespace snabl {
 	
 	class RuntimeError: public Error {
 	public:
+		const Pos pos;
 		RuntimeError(Env &env, Pos pos, const string &msg);
 		const char *what() const noexcept override;
+	protected:
+		RuntimeError(Env &env, Pos pos);
+		virtual void dump_msg(ostream &out) const;
 	private:
-		string _what;
+		Stack _stack;
+		Int _nstack;
+		string _msg;
+		mutable string _what;
 	};
 
 	class UserError: public RuntimeError {
 	public:
 		const Box val;
 		UserError(Env &env, Pos pos, const Box &_val);
+	protected:
+		void dump_msg(ostream &out) const override;
 	};
 }
 
@@ -2,17 +2,16 @@
 #define SNABL_SARRAY_HPP
 
 namespace snabl {
-	template <typename T, Int MAX_SIZE>
+	template <typename T, Int INIT_SIZE>
 	struct Sarray {
-		Sarray(): _size(0) { }
-		void push_back(T val) { _items[_size++] = val; }
-		Int size() const { return _size; }
-		T back() const { return _items[_size-1]; }
-		void pop_back() { _size--; }
-		void trunc(Int new_size) { _size = new_size; }
+		Sarray() { _items.reserve(INIT_SIZE); }
+		void push_back(T val) { _items.push_back(val); }
+		Int size() const { return _items.size(); }
+		T back() const { return _items.back(); }
+		void pop_back() { _items.pop_back(); }
+		void trunc(Int new_size) { _items.resize(new_size); }
 	private:
-		array<T, MAX_SIZE> _items;		
-		Int _size;
+		vector<T> _items;
 	};
 }
 
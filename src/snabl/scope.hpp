@@ -11,32 +11,40 @@ namespace snabl {
 
 	class Scope {
 	public:
-		static const Int MaxRegs = 8;
+		ScopePtr prev, source;
 		
-		ScopePtr prev;
-		const ScopePtr source;
-		
-		Scope(const ScopePtr &prev, const ScopePtr &source):
-			prev(prev), source(source) { }
+		Scope(const ScopePtr &prev, const ScopePtr &source, Int nvars=0):
+			prev(prev), source(source), _vars(nvars) { }
 
 		Scope(const Scope &) = delete;
 		const Scope &operator=(const Scope &) = delete;
 		
-		const Box *get(Sym id) const {
-			const auto found(_vars.find(id));
-			if (found != _vars.end()) { return &found->second; }
-			return source ? source->get(id) : nullptr;
+		const Box *get(Int depth, Int slot) const {
+			auto s(this);
+			for (; depth && s; depth--) { s = s->source.get(); }
+			if (!s || slot >= Int(s->_vars.size())) { return nullptr; }
+			const auto &v(s->_vars[slot]);
+			return v ? &*v : nullptr;
 		}
 
-		void let(Sym id, const Box &val) {
-			const auto ok(_vars.emplace(make_pair(id, val)));
-			if (!ok.second) { throw Error("Duplicate var: " + id.name()); }
+		void let(Sym id, Int slot, const Box &val) {
+			if (slot >= Int(_vars.size())) { _vars.resize(slot+1); }
+			auto &v(_vars[slot]);
+			if (v) { throw Error("Duplicate var: " + id.name()); }
+			v = val;
 		}
 
-		void clear_vars() { _vars.clear(); }
+		void clear_vars() { fill(_vars.begin(), _vars.end(), nullopt); }
+
+		void reset(const ScopePtr &prev, const ScopePtr &source, Int nvars) {
+			this->prev = prev;
+			this->source = source;
+			_regs.clear();
+			_vars.assign(nvars, nullopt);
+		}
 	private:
-		array<any, MaxRegs> _regs;
-		map<Sym, Box> _vars;
+		vector<any> _regs;
+		vector<optional<Box>> _vars;
 
 		friend Env;
 	};
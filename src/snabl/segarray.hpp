@@ -0,0 +1,75 @@
+#ifndef SNABL_SEGARRAY_HPP
+#define SNABL_SEGARRAY_HPP
+
+namespace snabl {
+	template <typename T, Int SEG_SIZE>
+	struct Segarray {
+		using Item = typename aligned_storage<sizeof(T), alignof(T)>::type;
+		static constexpr uintptr_t seg_bytes = SEG_SIZE*sizeof(Item);
+
+		Segarray(const Segarray &)=delete;
+		const Segarray &operator =(const Segarray &)=delete;
+
+		Segarray(): _last_seg(0), _size(0) { }
+		
+		~Segarray() {
+			for (Int i(0); i < _size; i++) { (*this)[i].~T(); }
+		}
+		
+		template <typename...ArgsT>
+		void emplace_back(ArgsT &&...args) {
+			if (_size == Int(_segs.size())*SEG_SIZE) { add_seg(); }
+			new (&_segs[_size/SEG_SIZE][_size%SEG_SIZE]) T(forward<ArgsT>(args)...);
+			_size++;
+		}
+
+		Int size() const { return _size; }
+		bool empty() const { return !_size; }
+		const T &back() const { return (*this)[_size-1]; }
+		T &back() { return (*this)[_size-1]; }
+
+		T &operator [](Int i) {
+			return reinterpret_cast<T &>(_segs[i/SEG_SIZE][i%SEG_SIZE]);
+		}
+
+		const T &operator [](Int i) const {
+			return reinterpret_cast<const T &>(_segs[i/SEG_SIZE][i%SEG_SIZE]);
+		}
+
+		// Returns the index of item or -1, segments are kept sorted by address
+		
+		Int index_of(const T *item) const {
+			const auto p(reinterpret_cast<uintptr_t>(item));
+			auto i(_seg_index.begin()+_last_seg);
+			
+			if (i == _seg_index.end() || p < i->first || p-i->first >= seg_bytes) {
+				i = upper_bound(_seg_index.begin(), _seg_index.end(), p,
+												[](uintptr_t p, const pair<uintptr_t, Int> &s) {
+													return p < s.first;
+												});
+				
+				if (i == _seg_index.begin()) { return -1; }
+				i--;
+				if (p-i->first >= seg_bytes) { return -1; }
+				_last_seg = i-_seg_index.begin();
+			}
+			
+			const Int idx(i->second*SEG_SIZE+Int((p-i->first)/sizeof(Item)));
+			return (idx < _size) ? idx : -1;
+		}
+	private:
+		vector<unique_ptr<Item[]>> _segs;
+		vector<pair<uintptr_t, Int>> _seg_index;
+		mutable Int _last_seg;
+		Int _size;
+
+		void add_seg() {
+			_segs.emplace_back(new Item[SEG_SIZE]);
+			const pair<uintptr_t, Int> s(reinterpret_cast<uintptr_t>(_segs.back().get()),
+																	 _segs.size()-1);
+			_seg_index.insert(upper_bound(_seg_index.begin(), _seg_index.end(), s), s);
+		}
+	};
+}
+
+#endif
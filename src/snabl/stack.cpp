@@ -1,17 +1,32 @@
+#include "snabl/fmt.hpp"
 #include "snabl/stack.hpp"
 
 namespace snabl {
-	ostream &operator <<(ostream &out, const Stack &stack) {
+	template <typename IterT>
+	static void dump_items(IterT begin, IterT end, ostream &out) {
 		out << '[';
 		char sep(0);
 		
-		for (auto &v: stack) {
+		for (auto i(begin); i != end; i++) {
 			if (sep) { out << sep; }
-			v.dump(out);
+			i->dump(out);
 			sep = ' ';
 		}
 		
 		out << ']';
+	}
+
+	ostream &operator <<(ostream &out, const Stack &stack) {
+		dump_items(stack.begin(), stack.end(), out);
 		return out;
 	}
+
+	ostream &operator <<(ostream &out, const ValStack &stack) {
+		dump_items(stack.begin(), stack.end(), out);
+		return out;
+	}
+
+	void ValStack::overflow() const {
+		throw Error(fmt("Stack overflow: %0", {Int(_max-_begin)}));
+	}
 }
@@ -6,8 +6,55 @@
 namespace snabl {
 	using Stack = vector<Box>;
 	using StackPtr = shared_ptr<Stack>;
+
+	class ValStack {
+	public:
+		using Item = typename aligned_storage<sizeof(Box), alignof(Box)>::type;
+
+		ValStack(const ValStack &)=delete;
+		const ValStack &operator =(const ValStack &)=delete;
+
+		ValStack(Int max_size):
+			_items(new Item[max_size]),
+			_begin(reinterpret_cast<Box *>(_items.get())),
+			_end(_begin),
+			_max(_begin+max_size) { }
+
+		~ValStack() { trunc(0); }
+
+		Box *begin() { return _begin; }
+		const Box *begin() const { return _begin; }
+		Box *end() { return _end; }
+		const Box *end() const { return _end; }
+		Int size() const { return _end-_begin; }
+		bool empty() const { return _end == _begin; }
+		Box &back() { return *(_end-1); }
+		const Box &back() const { return *(_end-1); }
+
+		template <typename...ArgsT>
+		void emplace_back(ArgsT &&...args) {
+			if (_end == _max) { overflow(); }
+			new (_end) Box(forward<ArgsT>(args)...);
+			_end++;
+		}
+
+		void push_back(const Box &val) { emplace_back(val); }
+		void pop_back() { (--_end)->~Box(); }
+
+		void trunc(Int new_size) {
+			for (const auto e(_begin+new_size); _end > e;) { (--_end)->~Box(); }
+		}
+	private:
+		unique_ptr<Item[]> _items;
+		Box *const _begin, *_end, *const _max;
+
+		[[noreturn]] void overflow() const;
+
+		friend class Jit;
+	};
 	
 	ostream &operator <<(ostream &out, const Stack &stack);
+	ostream &operator <<(ostream &out, const ValStack &stack);
 }
 
 #endif
@@ -2,14 +2,14 @@
 #define SNABL_STARRAY_HPP
 
 namespace snabl {
-	template <typename T, Int MAX_SIZE>
+	template <typename T, Int INIT_SIZE>
 	struct Starray {
 		using Item = typename aligned_storage<sizeof(T), alignof(T)>::type;
 
 		Starray(const Starray &)=delete;
 		const Starray &operator =(const Starray &)=delete;
 
-		Starray(): _size(0) { }
+		Starray(): _items(new Item[INIT_SIZE]), _size(0), _max_size(INIT_SIZE) { }
 		
 		~Starray() {
 			for (Int i(0); i < _size; i++) { get(i).~T(); }
@@ -17,7 +17,9 @@ namespace snabl {
 		
 		template <typename...ArgsT>
 		void emplace_back(ArgsT &&...args) {
-			new (&_items[_size++]) T(forward<ArgsT>(args)...);
+			if (_size == _max_size) { grow(); }
+			new (&_items[_size]) T(forward<ArgsT>(args)...);
+			_size++;
 		}
 
 		Int size() const { return _size; }
@@ -29,11 +31,24 @@ namespace snabl {
 			for (; _size > new_size; _size--) { get(_size-1).~T(); }
 		}
 	private:
-		array<Item, MAX_SIZE> _items;		
-		Int _size;
+		unique_ptr<Item[]> _items;
+		Int _size, _max_size;
 
 		T &get(Int i) { return reinterpret_cast<T &>(_items[i]); }
 		const T &get(Int i) const { return reinterpret_cast<const T &>(_items[i]); }
+
+		void grow() {
+			const Int max_size(_max_size*2);
+			unique_ptr<Item[]> items(new Item[max_size]);
+
+			for (Int i(0); i < _size; i++) {
+				new (&items[i]) T(move(get(i)));
+				get(i).~T();
+			}
+			
+			_items.swap(items);
+			_max_size = max_size;
+		}
 	};
 }
 
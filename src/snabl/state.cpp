@@ -7,12 +7,18 @@ namespace snabl {
 		_scope(env._scope),
 		_ncalls(env._task->_calls.size()),
 		_ntries(env._task->_tries.size()),
-		_nstack(env._stack.size()),
-		_nsplits(env._task->_splits.size()) { }
+		_nstack(env._task->_stack.size()),
+		_nsplits(env._task->_splits.size()),
+		_nframes(env._task->_nframes) { }
 
 	void State::restore_lib(Env &env) const { env._lib = &_lib; }
 
-	void State::restore_scope(Env &env) const { env._scope = _scope; }
+	void State::restore_scope(Env &env) const {
+		env._scope = _scope;
+		auto &fs(env._task->_frames);
+		auto &n(env._task->_nframes);
+		for (; n > _nframes; n--) { fs[n-1].reset(nullptr, nullptr, 0); }
+	}
 
 	void State::restore_calls(Env &env) const {
 		auto &calls(env._task->_calls);
@@ -23,11 +29,7 @@ namespace snabl {
 		if (env._task->_tries.size() > _ntries) { env._task->_tries.trunc(_ntries); }
 	}
 
-	void State::restore_stack(Env &env) const {
-		if (Int(env._stack.size()) > _nstack) {
-			env._stack.erase(env._stack.begin()+_nstack, env._stack.end());
-		}
-	}
+	void State::restore_stack(Env &env) const { env._task->_stack.trunc(_nstack); }
 
 	void State::restore_splits(Env &env) const {
 		if (env._task->_splits.size() > _nsplits) { env._task->_splits.trunc(_nsplits); }
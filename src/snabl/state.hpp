@@ -20,7 +20,7 @@ namespace snabl {
 	private:
 		Lib &_lib;
 		const ScopePtr _scope;
-		const Int _ncalls, _ntries, _nstack, _nsplits;
+		const Int _ncalls, _ntries, _nstack, _nsplits, _nframes;
 	};
 }
 
@@ -6,6 +6,8 @@
 
 #include <algorithm>
 #include <any>
+#include <array>
+#include <charconv>
 #include <chrono>
 #include <deque>
 #include <fstream>
@@ -12,7 +12,7 @@ namespace snabl {
 		const string name;
 		const Int hash;
 
-		SymImp(const string &name): name(name), hash(std::hash<string>{}(name)) { }
+		SymImp(string_view name): name(name), hash(std::hash<string_view>{}(name)) { }
 	};
 
 	class Sym {
@@ -2,6 +2,7 @@
 #define SNABL_TARGET_HPP
 
 #include "snabl/call.hpp"
+#include "snabl/jit.hpp"
 #include "snabl/ptrs.hpp"
 #include "snabl/state.hpp"
 #include "snabl/types.hpp"
@@ -9,24 +10,29 @@
 namespace snabl {
 	class Target {
 	public:
-		enum class Opts: int {None=0, Recalls, Regs, Vars};
+		enum class Opts: int {None=0, Recalls=1, Regs=2, Vars=4, Escapes=8};
 		
 		Target(const ScopePtr &parent_scope=nullptr,
-					 const OpImp &start_pc=nullptr, Int end_pc=-1,
-					 Opts opts=Opts::None):
+					 PC start_pc=nullptr, Int end_pc=-1,
+					 Opts opts=Opts::None, Int nvars=0):
 			_parent_scope(parent_scope),
 			_start_pc(start_pc), _end_pc(end_pc),
-			_opts(opts) { }
+			_opts(opts), _nvars(nvars), _ncalls(0), _jit_fn(nullptr) { }
 
 		virtual ~Target() { }
 		virtual string target_id() const=0;
-		const OpImp &start_pc() const { return _start_pc; }
+		const ScopePtr &parent_scope() const { return _parent_scope; }
+		PC start_pc() const { return _start_pc; }
+		Int end_pc() const { return _end_pc; }
 		Opts opts() const { return _opts; }
+		Int nvars() const { return _nvars; }
 	protected:
 		ScopePtr _parent_scope;
-		OpImp _start_pc;
+		PC _start_pc;
 		Int _end_pc;
 		Opts _opts;
+		Int _nvars, _ncalls;
+		Jit::Fn _jit_fn;
 
 		friend Env;
 	};
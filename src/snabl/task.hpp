@@ -3,7 +3,10 @@
 
 #include "snabl/op.hpp"
 #include "snabl/sarray.hpp"
+#include "snabl/scope.hpp"
+#include "snabl/stack.hpp"
 #include "snabl/starray.hpp"
+#include "snabl/state.hpp"
 
 namespace snabl {
 	class Env;
@@ -11,14 +14,22 @@ namespace snabl {
 	struct Task;
 	using TaskPtr = shared_ptr<Task>;
 
+	struct Try {
+		const Op &op;
+		const State state;
+		Try(const Op &op, const Env &env): op(op), state(env) { }
+	};
+
 	struct Task {
 		enum class Status {New, Running, Yielding, Done};
-		static const Int MaxCalls = 8;
-		static const Int MaxSplits = 8;
-		static const Int MaxTries = 8;
+		static const Int CallsInitSize = 64;
+		static const Int SplitsInitSize = 8;
+		static const Int StackSize = 1 << 20;
+		static const Int TriesInitSize = 8;
 		
 		Task(const TaskPtr &next):
-			_prev(nullptr), _next(next), _status(Status::New), _pc(nullptr) {
+			_prev(nullptr), _next(next), _status(Status::New), _pc(nullptr),
+			_stack(StackSize), _nframes(0) {
 			if (next) {
 				_prev = next->_prev;
 				next->_prev = this;
@@ -29,10 +40,13 @@ namespace snabl {
 		TaskPtr _next;
 		Status _status;		
 		PC _pc;
+		ValStack _stack;
 
-		Starray<Call, MaxCalls> _calls;
-		Sarray<ops::Try *, MaxTries> _tries;
-		Sarray<Int, MaxSplits> _splits;
+		Starray<Call, CallsInitSize> _calls;
+		Starray<Try, TriesInitSize> _tries;
+		Sarray<Int, SplitsInitSize> _splits;
+		deque<Scope> _frames;
+		Int _nframes;
 		
 		friend Env;
 		friend State;
@@ -5,7 +5,7 @@
 #include "snabl/type.hpp"
 
 namespace snabl {
-	using Float = long double;
+	using Float = double;
 	
 	class FloatType: public Type<Float> {
 	public:
@@ -13,6 +13,10 @@ namespace snabl {
 		return *lhs.as<StrPtr>() == *rhs.as<StrPtr>();
 	}
 
+	Cmp StrType::cmp(const Box &lhs, const Box &rhs) const {
+		return snabl::cmp(*lhs.as<StrPtr>(), *rhs.as<StrPtr>());
+	}
+
 	void StrType::dump(const Box &val, ostream &out) const {
 		out << "''" << *val.as<StrPtr>() << "''";
 	}
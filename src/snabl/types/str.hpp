@@ -11,6 +11,7 @@ namespace snabl {
 		StrType(Lib &lib, Sym id);
 		bool as_bool(const Box &val) const override;
 		bool eqval(const Box &lhs, const Box &rhs) const override;
+		Cmp cmp(const Box &lhs, const Box &rhs) const override;
 		IterPtr iter(const Box &val) const override;
 		void dump(const Box &val, ostream &out) const override;
 	};
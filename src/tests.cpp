@@ -1,4 +1,10 @@
+#include <filesystem>
+
+#include <unistd.h>
+
+#include "snabl/env.hpp"
 #include "snabl/fmt.hpp"
+#include "snabl/parser.hpp"
 #include "snabl/std.hpp"
 
 namespace snabl {
@@ -9,7 +15,440 @@ namespace snabl {
 		assert(fmt("%%0", {}) == "%0");
 	}
 
+	void fimp_cache_tests() {
+		Env env;
+		const auto &s(env.fimp_cache_stats());
+		env.run("func: foo<Int> 1 func: bar<T> foo");
+		env.run("2 bar; 3 bar");
+		assert(s.hits == 1 && s.megamorphic == 0);
+		assert(env.stack().back().as<Int>() == 1);
+		env.run("func: foo<Int> 4");
+		env.run("5 bar");
+		assert(env.stack().back().as<Int>() == 4);
+	}
+	
+	void infer_tests() {
+		Env env;
+		const auto &s(env.infer_stats());
+		env.compile("func: foo<Int> 1 func: foo<Sym> 2 42 let: baz");
+		const auto calls(s.calls), resolved(s.resolved);
+		env.compile("3 foo; 'bar foo; @baz foo");
+		assert(s.calls == calls+3 && s.resolved == resolved+2);
+	}
+	
+	void peephole_tests() {
+		Env env;
+		const Int start_pc(env.ops().size());
+		env.run("1 2 swap! swap! 42 drop! _ 3");
+		assert(env.live_ops(start_pc, env.ops().size()).size() == 3);
+		assert(env.stack().size() == 3);
+	}
+	
+	void fold_tests() {
+		Env env;
+		Int start_pc(env.ops().size());
+		env.run("1 + 2; * 3");
+		assert(env.live_ops(start_pc, env.ops().size()).size() == 1);
+		assert(env.stack().back().as<Int>() == 9);
+
+		start_pc = env.ops().size();
+		env.compile("0 ms; sleep");
+		assert(env.live_ops(start_pc, env.ops().size()).size() == 2);
+
+		start_pc = env.ops().size();
+		env.compile("''a'' < ''b''");
+		assert(env.live_ops(start_pc, env.ops().size()).size() == 1);
+
+		start_pc = env.ops().size();
+		env.compile("'a < 'b");
+		assert(env.live_ops(start_pc, env.ops().size()).size() == 3);
+	}
+	
+	void var_tests() {
+		Env env;
+		env.run("42 let: foo");
+		env.run("@foo");
+		assert(env.stack().back().as<Int>() == 42);
+
+		try {
+			env.compile("@bar");
+			assert(false);
+		} catch (const CompileError &) { }
+	}
+	
+	void call_tests() {
+		Env env;
+		env.max_calls = 100;
+		env.run("func: depth<Int> (switch:, 0? 0, --; depth; ++)");
+
+		try {
+			env.run("1000 depth");
+			assert(false);
+		} catch (const RuntimeError &) { }
+	}
+	
+	void try_tests() {
+		Env env;
+
+		try {
+			env.run("1 2 throw 42");
+			assert(false);
+		} catch (const UserError &e) {
+			assert(e.val.as<Int>() == 42);
+		}
+
+		env.run("try: (catch; ++), throw 41");
+		assert(env.stack().back().as<Int>() == 42);
+
+		env.run("func: raise<Int> throw");
+		env.run("func: throw<Int> (drop! 'custom)");
+		env.run("5 throw");
+		assert(env.stack().back().as<Sym>() == env.sym("custom"));
+		env.run("6 raise");
+		assert(env.stack().back().as<Sym>() == env.sym("custom"));
+
+		Env henv;
+		const auto held(make_shared<Stack>());
+		henv.run("func: hold<Stack> (let: x 1 throw)");
+		henv.push(henv.stack_type, held);
+		henv.run("try: (catch; drop!), hold");
+		assert(held.use_count() == 1);
+	}
+	
+	void error_tests() {
+		Env env;
+		env.max_error_items = 2;
+
+		try {
+			env.run("1 2 3 4 drop! drop! drop! drop! drop!");
+			assert(false);
+		} catch (const RuntimeError &e) {
+			assert(string(e.what()).find("[]") == 0);
+		}
+
+		try {
+			env.run("1 2 3 4 nil throw");
+			assert(false);
+		} catch (const RuntimeError &e) {
+			assert(string(e.what()).find("[... 4 nil]") == 0);
+		}
+	}
+	
+	void stack_tests() {
+		Env env;
+		const Box v(env.int_type, Int(42));
+		ValStack s(2);
+		s.push_back(v);
+		s.push_back(v);
+
+		try {
+			s.push_back(v);
+			assert(false);
+		} catch (const Error &) { }
+
+		assert(s.size() == 2);
+		s.trunc(1);
+		assert(s.back().as<Int>() == 42);
+	}
+	
+	void depth_tests() {
+		Env env;
+		Int start_pc(env.ops().size());
+		env.compile("func: foo<Int Int> (swap! drop! drop!)");
+		Int nunchecked(0);
+		
+		for (Int pc(start_pc); pc < Int(env.ops().size()); pc++) {
+			auto &op(env.ops()[pc]);
+			if (op.code != op.type.code) { nunchecked++; }
+		}
+
+		assert(nunchecked == 3);
+		start_pc = env.ops().size();
+		env.compile("drop!");
+		assert(env.ops()[start_pc].depth == 0);
+		assert(env.ops()[start_pc].code == OpCode::Drop);
+	}
+	
+	void link_tests() {
+		Env env;
+		const Int start_pc(env.ops().size());
+		env.compile("t if: 1 2");
+		const Op *jump(nullptr);
+		
+		for (Int pc(start_pc); pc < env.ops().size(); pc++) {
+			auto &op(env.ops()[pc]);
+			if (op.code == OpCode::Jump) { jump = &op; }
+		}
+
+		assert(jump && !jump->branch);
+		env.compile("42");
+		assert(jump->branch == &env.ops()[jump->as<ops::Jump>().end_pc]);
+	}
+	
+	void jit_tests() {
+		Env env;
+		env.jit = true;
+		env.jit_threshold = 1;
+		const auto &s(env.jit_stats());
+
+		env.run("func: tail-fib<Int Int Int> "
+						"(rswap! switch:, 0? sdrop! 1? drop!, --; rswap! dup! rot! +; recall!)");
+
+		env.run("20 0 1 tail-fib");
+		assert(s.fns == 1);
+		assert(env.stack().back().as<Int>() == 6765);
+
+		env.run("func: sw<T> (switch:, 1? 'one, 'other)");
+		env.run("1 sw; 'foo sw");
+		assert(s.fns == 2);
+		assert(env.stack().back().as<Sym>() == env.sym("other"));
+		env.run("ddrop! drop! 1 sw");
+		assert(env.stack().back().as<Sym>() == env.sym("one"));
+	}
+
+	void redef_tests() {
+		for (const auto jit: {false, true}) {
+			Env env;
+			env.jit = jit;
+			env.jit_threshold = 1;
+			env.run("func: g<Int Int> + func: h<Int> (1 +)");
+			env.run("3 4 g; 3 h");
+			env.run("func: +<Int Int> (drop! drop! 0)");
+			env.run("3 4 g");
+			assert(env.stack().back().as<Int>() == 0);
+			env.run("3 h");
+			assert(env.stack().back().as<Int>() == 0);
+		}
+
+		Env env;
+		env.run("3 let: x @x 4 + func: +<Int Int> (drop! drop! 0)");
+		assert(env.stack().back().as<Int>() == 0);
+	}
+	
+	void bytecode_tests() {
+		stringstream buf;
+
+		{
+			Env env;
+			env.compile("func: foo<Int> (switch:, 0? 'zero, 3 times: ++) "
+									"41 let: bar 0 foo; 1 foo; @bar {++} call!");
+			env.save(buf, 0, env.ops().size());
+		}
+
+		Env env;
+		env.load(buf.str());
+		env.jump(Int(0));
+		env.run();
+		assert(env.stack().size() == 3);
+		assert(env.stack().begin()->as<Sym>() == env.sym("zero"));
+		assert((env.stack().begin()+1)->as<Int>() == 4);
+		assert(env.stack().back().as<Int>() == 42);
+		env.run("2 foo");
+		assert(env.stack().back().as<Int>() == 5);
+
+		auto bad(buf.str());
+		bad[8]++;
+
+		try {
+			Env().load(bad);
+			assert(false);
+		} catch (const Error &e) {
+			assert(string(e.what()).find("version") != string::npos);
+		}
+
+		buf.str("");
+
+		{
+			Env env;
+			env.compile("2 let: b func: getb<Int> (drop! @b) (@b) (0 getb) ({@b} call!)");
+			env.save(buf, 0, env.ops().size());
+		}
+
+		Env renv;
+		renv.run("1 let: a");
+		const Int start_pc(renv.ops().size());
+		renv.load(buf.str());
+		renv.jump(start_pc);
+		renv.run();
+		assert(renv.stack().size() == 3);
+		for (auto &v: renv.stack()) { assert(v.as<Int>() == 2); }
+		renv.run("@a");
+		assert(renv.stack().back().as<Int>() == 1);
+	}
+
+	void cache_tests() {
+		const auto dir(filesystem::temp_directory_path() /
+									 fmt("snabl-cache-%0", {Int(getpid())}));
+		filesystem::create_directory(dir);
+		const auto path((dir / "b.sl").string());
+		ofstream(path) << "1 2 +";
+
+		{
+			Env env;
+			env.compile_cached(path, dir.string());
+			env.jump(Int(0));
+			env.run();
+			assert(env.stack().back().as<Int>() == 3);
+		}
+		
+		Env env;
+		env.run("func: +<Int Int> (drop! drop! 0)");
+		const Int start_pc(env.ops().size());
+		env.compile_cached(path, dir.string());
+		env.jump(start_pc);
+		env.run();
+		assert(env.stack().back().as<Int>() == 0);
+		filesystem::remove_all(dir);
+	}
+
+	void image_tests() {
+		stringstream buf;
+
+		{
+			Env env;
+			env.run("func: foo<Int> (++) 41 let: bar 'baz 7 foo");
+			env.save_image(buf);
+		}
+
+		Env env;
+		env.load(buf.str());
+		assert(env.stack().size() == 2);
+		assert(env.stack().back().as<Int>() == 8);
+		env.run("@bar foo");
+		assert(env.stack().back().as<Int>() == 42);
+
+		try {
+			env.load(buf.str());
+			assert(false);
+		} catch (const Error &e) {
+			assert(string(e.what()) == "Images require a fresh env");
+		}
+
+		buf.str("");
+		
+		{
+			Env env;
+			env.run("[1 2 3] let: xs {++} let: inc @xs");
+			env.save_image(buf);
+		}
+
+		Env env2;
+		env2.load(buf.str());
+		assert(env2.stack().back().as<StackPtr>()->size() == 3);
+		assert(env2.stack().back().as<StackPtr>() ==
+					 (*env2.root_scope->get(0, 0)).as<StackPtr>());
+		env2.run("41 @inc call!");
+		assert(env2.stack().back().as<Int>() == 42);
+
+		env2.run("func: mk<Int> (let: x {@x}) (1 mk) let: get");
+
+		try {
+			env2.save_image(buf);
+			assert(false);
+		} catch (const Error &e) {
+			assert(string(e.what()).find("var get") != string::npos);
+		}
+	}
+
+	void parser_tests() {
+		Env env;
+		const string id("foo-bar");
+		assert(env.sym(string_view(id).substr(0, 3)) == env.sym("foo"));
+		env.run("2.25 -1.5 ''it's'' 'foo-bar");
+		auto i(env.stack().end());
+		assert((i-4)->as<Float>() == 2.25);
+		assert((i-3)->as<Float>() == -1.5);
+		assert(*(i-2)->as<StrPtr>() == "it's");
+		assert((i-1)->as<Sym>() == env.sym(id));
+
+		env.run("1-2");
+		assert((env.stack().end()-2)->as<Int>() == 1);
+		assert(env.stack().back().as<Int>() == -2);
+
+		try {
+			env.run("''foo");
+			assert(false);
+		} catch (const SyntaxError &) { }
+
+		try {
+			env.run("1.2.3");
+			assert(false);
+		} catch (const SyntaxError &) { }
+	}
+
+	void arena_tests() {
+		struct Counter {
+			Int &n;
+			Counter(Int &n): n(n) { }
+			~Counter() { n++; }
+		};
+
+		Int n(0);
+		
+		{
+			Arena arena;
+			for (Int i(0); i < 1000; i++) { arena.make<Counter>(n); }
+			const vector<Int> vs(10000, 42);
+			const auto p(arena.copy<Int>(vs.begin(), vs.end()));
+			assert(p[0] == 42 && p[9999] == 42);
+		}
+		
+		assert(n == 1000);
+
+		Env env;
+		Arena arena;
+		Forms fs;
+		Parser(env, arena).parse("1 foo?", fs);
+		assert(fs.size() == 2);
+		assert(&fs.back().as<forms::Query>().form.type == &forms::Id::type);
+	}
+
+	void compile_tests() {
+		Env env;
+		env.compile("func: foo<Int> (let: x {@x}) func: bar<Int> (1 +)");
+		const auto &foo(*(*env.lib().get_func(env.sym("foo")))->get_fimp());
+		assert(foo.opts() & Target::Opts::Vars && foo.opts() & Target::Opts::Escapes);
+		const auto &bar(*(*env.lib().get_func(env.sym("bar")))->get_fimp());
+		assert(!(bar.opts() & Target::Opts::Vars));
+		
+		const auto d(env.lib().get_defs(env.sym("if:")));
+		assert(d && d->macro && !d->func);
+		
+		const auto &ops(env.ops());
+		for (Int pc(0); pc < ops.size(); pc++) { assert(ops.index_of(&ops[pc]) == pc); }
+		assert(ops.index_of(nullptr) == -1);
+
+		try {
+			env.run("func: bad<Int> (nosuchthing)");
+			assert(false);
+		} catch (const CompileError &) { }
+
+		try {
+			env.run("1 bad");
+			assert(false);
+		} catch (const Error &) { }
+	}
+
 	void all_tests() {
 		fmt_tests();
+		fimp_cache_tests();
+		infer_tests();
+		peephole_tests();
+		fold_tests();
+		var_tests();
+		call_tests();
+		try_tests();
+		error_tests();
+		stack_tests();
+		depth_tests();
+		link_tests();
+		jit_tests();
+		redef_tests();
+		bytecode_tests();
+		cache_tests();
+		image_tests();
+		parser_tests();
+		arena_tests();
+		compile_tests();
 	}
 }